@@ -1,6 +1,8 @@
 #ifndef SPARSEMATRIX_HPP
 #define SPARSEMATRIX_HPP
 #include "SparseMatrixTraits.hpp"
+#include "SparseMatrixParallel.hpp"
+#include "SparseMatrixAnalysis.hpp"
 #include <map>
 #include <array>
 #include <vector>
@@ -12,6 +14,14 @@
 #include<numeric>
 #include<cmath>
 #include <fstream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <cctype>
+#include <span>
+#include <charconv>
+#include <string_view>
+#include <chrono>
 
 namespace algebra {
 
@@ -30,7 +40,94 @@ namespace algebra {
     };
     
     enum class StorageOrder { RowMajor, ColumnMajor };
+    //Precision used to store the values once the matrix is compressed:
+    //Reduced keeps them in ReducedPrecision_t<T> (e.g. float for double) to halve the memory traffic,
+    //Split (only for complex matrices) keeps the full precision with the real and the imaginary parts
+    //in two arrays, so the product works on real arrays that the compiler can vectorize
+    enum class StoragePrecision { Full, Reduced, Split };
+    //Symmetric and Hermitian matrices store only one triangle (diagonal included),
+    //the other one is obtained by symmetry (by conjugation for Hermitian)
+    enum class Symmetry { General, Symmetric, Hermitian };
+    enum class Triangle { Lower, Upper };
     
+    //Index structure of a compressed matrix. It is immutable once built and it is shared
+    //(through a shared_ptr) by all the matrices with the same non zero pattern.
+    //The outer direction is the row for RowMajor and the column for ColumnMajor
+    template<StorageOrder Order>
+    struct SparsityPattern {
+        std::size_t numRows;
+        std::size_t numCols;
+        //the outer i has the inner indexes innerIndex[outerIndex[i]:outerIndex[i+1]], sorted.
+        //The arrays are filled by the threads that use them in the kernels (first touch)
+        parallel::first_touch_vector<std::size_t> outerIndex;
+        parallel::first_touch_vector<std::size_t> innerIndex;
+        std::size_t nonZeros()const{return innerIndex.size();};
+        //position of (row,col) in innerIndex, nonZeros() if it is not stored
+        std::size_t locate(std::size_t row,std::size_t col)const;
+        //true if the pattern is square and all the stored elements are in the triangle (diagonal included)
+        bool in_triangle(Triangle triangle)const;
+        //split of the outer indexes among the threads (see parallel::for_each_outer), set by balance.
+        //The index and value arrays are filled with this split and the kernels use it
+        bool byElements = false;
+        //chooses the split from the lengths, called once outerIndex is complete and before
+        //the other arrays are filled
+        void balance();
+        //calls f(chunk,begin,end) on the blocks of outer indexes of the split
+        template<typename F>
+        void for_each_outer(F&& f)const{parallel::for_each_outer(outerIndex,byElements,std::forward<F>(f));}
+        //statistics of the structure and kernel chosen for the product, set by analyze
+        StructureInfo structure;
+        //runs of consecutive inner indexes, only when the kernel is Blocked: the outer i has the runs
+        //runPtr[i]:runPtr[i+1], the run r has the positions runStart[r]:runStart[r+1]
+        parallel::first_touch_vector<std::size_t> runPtr;
+        parallel::first_touch_vector<std::size_t> runStart;
+        //computes structure, called once the index arrays are filled. The runs are built only if the
+        //Blocked kernel is chosen, which needs a RowMajor pattern of a matrix with symmetry General
+        void analyze(Symmetry symmetry);
+    };
+
+    template<StorageOrder Order>
+    using PatternPtr = std::shared_ptr<const SparsityPattern<Order>>;
+
+    //View (without copies) of a row of a CSR matrix or of a column of a CSC matrix:
+    //the inner indexes (sorted) and the values of the stored elements
+    template<ScalarOrComplex T>
+    struct SparseVectorView {
+        std::span<const std::size_t> index;
+        std::span<const T> values;
+        std::size_t size()const{return index.size();};
+    };
+
+    //Values of a complex matrix stored with StoragePrecision::Split, as given by visit_values:
+    //vals[k] gives back the complex value from the two arrays of the parts
+    template<typename R>
+    struct SplitComplexValues {
+        const R* real;
+        const R* imag;
+        std::size_t count;
+        std::complex<R> operator[](std::size_t k)const{return {real[k],imag[k]};};
+        std::size_t size()const{return count;};
+    };
+
+    //Matrix without values (structural matrix), the element (i,j) is true if it is stored.
+    //Used for graph algorithms and to share the pattern between matrices
+    template<StorageOrder Order>
+    class PatternMatrix {
+    private:
+        PatternPtr<Order> pattern_;
+    public:
+        explicit PatternMatrix(PatternPtr<Order> pattern);
+        bool operator()(std::size_t row,std::size_t col)const;
+        std::size_t rows()const{return pattern_->numRows;};
+        std::size_t cols()const{return pattern_->numCols;};
+        std::size_t nonZeros()const{return pattern_->nonZeros();};
+        const PatternPtr<Order>& pattern()const{return pattern_;};
+    };
+
+    //Boolean product: result[i] is true if there is a j with (i,j) stored and vec[j] true
+    template<StorageOrder Order>
+    std::vector<bool> operator*(const PatternMatrix<Order>& matrix,const std::vector<bool>& vec);
+
     template<ScalarOrComplex T,StorageOrder Order>
     class Matrix;
     
@@ -42,31 +139,170 @@ namespace algebra {
     
     template<ScalarOrComplex T, StorageOrder Order>
     std::vector<T> operator*(const Matrix<T, Order>& matrix, const Matrix<T,Order>& vec);
+
+    template<ScalarOrComplex T, StorageOrder Order, parallel::VectorOf<T> X = std::vector<T>, parallel::VectorOf<T> Y>
+    void multiply(const Matrix<T,Order>& matrix,const X& vec,Y& result);
+
+    template<ScalarOrComplex T, StorageOrder Order>
+    SpMVKernel autotune(Matrix<T,Order>& matrix);
+
+    template<ScalarOrComplex T, StorageOrder Order>
+    Matrix<T,Order> add(const std::type_identity_t<T>& alpha,const Matrix<T,Order>& A,const std::type_identity_t<T>& beta,const Matrix<T,Order>& B);
+
+    template<ScalarOrComplex T, StorageOrder Order>
+    Matrix<T,Order> extract(const Matrix<T,Order>& matrix,const std::vector<std::size_t>& rowSet,const std::vector<std::size_t>& colSet);
   
     template <ScalarOrComplex T>
     class Matrix<T, StorageOrder::RowMajor> : public SparseMatrixBase<T> {
     private:
         std::map<std::array<std::size_t, 2>, T> elements;
-        std::vector<std::vector<std::pair<std::size_t,T>>> compressedMatrix;
+        //Compressed (CSR) format, the index structure can be shared with other matrices
+        PatternPtr<StorageOrder::RowMajor> pattern_;
+        //Only the vectors of the precision are used (values, reducedValues or the split parts)
+        parallel::first_touch_vector<T> values;
+        parallel::first_touch_vector<ReducedPrecision_t<T>> reducedValues;
+        parallel::first_touch_vector<RealType_t<T>> realValues;
+        parallel::first_touch_vector<RealType_t<T>> imagValues;
+        //writes the values with the split of the pattern, so every thread touches first its part:
+        //fill(begin,end,store) calls store(k,value) for the positions k of the outer indexes [begin,end)
+        //of a block, the value is stored with the precision of the matrix. The index arrays can be
+        //written in the same pass
+        template<typename F>
+        void assign_outer(F&& fill){
+            const std::size_t size = pattern_->outerIndex.back();
+            auto run = [&](auto&& store){
+                pattern_->for_each_outer([&](std::size_t,std::size_t begin,std::size_t end){
+                    fill(begin,end,store);
+                });
+            };
+            if(precision == StoragePrecision::Full){
+                parallel::resize(values,size);
+                run([this](std::size_t k,const T& value){values[k] = value;});
+            }else if(precision == StoragePrecision::Reduced){
+                parallel::resize(reducedValues,size);
+                run([this](std::size_t k,const T& value){reducedValues[k] = static_cast<ReducedPrecision_t<T>>(value);});
+            }else{
+                parallel::resize(realValues,size);
+                parallel::resize(imagValues,size);
+                run([this](std::size_t k,const T& value){
+                    realValues[k] = std::real(value);
+                    imagValues[k] = std::imag(value);
+                });
+            }
+        }
+        //sets the values to value(k) for the position k, stored with the precision of the matrix
+        template<typename F>
+        void assign_values(F&& value){
+            assign_outer([this,&value](std::size_t begin,std::size_t end,auto&& store){
+                for(std::size_t k=pattern_->outerIndex[begin];k<pattern_->outerIndex[end];++k){
+                    store(k,value(k));
+                }
+            });
+        }
+        StoragePrecision precision;
+        //kernel of the product, chosen at compress() from the structure of the pattern
+        SpMVKernel spmvKernel = SpMVKernel::RowByRow;
+        //chooses spmvKernel for a new pattern (with the autotuning, if enabled), once the values
+        //and the symmetry are set
+        void select_kernel();
         std::size_t numRows;
         std::size_t numCols;
         bool isCompressed;
+        Symmetry symmetryType;
+        Triangle storedTriangle;
+        bool in_stored_triangle(std::size_t row,std::size_t col)const{
+            return storedTriangle == Triangle::Lower ? row >= col : row <= col;
+        };
+        //value of the element (row,col), also when it is obtained by symmetry. Empty if not stored
+        std::optional<T> find(std::size_t row,std::size_t col)const;
+        T symmetric_norm(const algebra::Typenorm& norm_)const;
+        //tag of the constructor that leaves the values to the caller
+        struct ValuesLater {};
+        //compressed matrix on pattern without values and without checking the triangle: the caller
+        //writes the values (with assign_values or assign_outer) and then calls select_kernel
+        Matrix(PatternPtr<StorageOrder::RowMajor> pattern,StoragePrecision precision_,Symmetry symmetry_,Triangle triangle_,ValuesLater);
 
     public:
         // Declaration of the class specification RowMajor
         Matrix(std::size_t nrow,std::size_t ncol);
+        //compressed matrix with all the values equal to zero on an existing pattern, the values are
+        //then assembled without any index work with set_values, or with operator() if the precision is Full.
+        //The kernel is the cached or the analyzed one, autotune() can be called once assembled
+        //A symmetric (Hermitian) matrix needs a pattern with only the stored triangle, as the one of a
+        //symmetric matrix: Matrix(S.pattern(),S.storage_precision(),S.symmetry(),S.triangle())
+        explicit Matrix(PatternPtr<StorageOrder::RowMajor> pattern,StoragePrecision precision_ = StoragePrecision::Full,
+                        Symmetry symmetry_ = Symmetry::General,Triangle triangle_ = Triangle::Lower);
         bool is_compressed()const{return isCompressed;};
         T operator()(std::size_t row, std::size_t col) const override;
         void resize(std::size_t nrow,std::size_t ncol);
         T& operator()(std::size_t row, std::size_t col) override;
         void compress() override;
+        //compress storing the values with the given precision, a compressed matrix stores them
+        //again with it on its pattern
+        void compress(StoragePrecision precision_);
+        StoragePrecision storage_precision()const{return precision;};
+        SpMVKernel kernel()const{return spmvKernel;};
+        //forces the kernel of the product (Blocked only if the pattern has the runs)
+        void set_kernel(SpMVKernel kernel_);
+        std::size_t rows()const{return numRows;};
+        std::size_t cols()const{return numCols;};
+        std::size_t nonZeros()const{return isCompressed ? pattern_->nonZeros() : elements.size();};
+        //pattern of the compressed matrix, nullptr if the matrix is not compressed
+        const auto& pattern()const{return pattern_;};
+        //replace the values keeping the pattern, the values are given in the compressed order
+        void set_values(std::vector<T> newValues);
+        //stored elements of the row i of the compressed matrix, without copies
+        //(only one triangle for symmetric matrices, not available with reduced precision)
+        SparseVectorView<T> row(std::size_t i)const;
+        //Calls f with the vector of the stored values (values, reducedValues or SplitComplexValues),
+        //so that the kernels can be instantiated once per precision without branching in the inner loop
+        template<typename F>
+        decltype(auto) visit_values(F&& f)const{
+            if constexpr(Complex<T>){
+                if(precision == StoragePrecision::Split){
+                    return f(SplitComplexValues<RealType_t<T>>{realValues.data(),imagValues.data(),realValues.size()});
+                }
+            }
+            if(precision == StoragePrecision::Reduced){
+                return f(reducedValues);
+            }
+            return f(values);
+        }
+        //Calls f(row,col,value) for each stored element (only one triangle for symmetric matrices)
+        template<typename F>
+        void for_each_stored(F&& f)const{
+            if(!isCompressed){
+                for(const auto& [key,value] : elements){
+                    f(key[0],key[1],value);
+                }
+                return;
+            }
+            visit_values([&](const auto& vals){
+                for(std::size_t i=0;i+1<pattern_->outerIndex.size();++i){
+                    for(std::size_t k=pattern_->outerIndex[i];k<pattern_->outerIndex[i+1];++k){
+                        f(i,pattern_->innerIndex[k],static_cast<T>(vals[k]));
+                    }
+                }
+            });
+        }
+        Symmetry symmetry()const{return symmetryType;};
+        Triangle triangle()const{return storedTriangle;};
+        //set the symmetry of a not compressed matrix, the elements outside the stored triangle
+        //are moved in it (if the symmetric one is not already there)
+        void set_symmetry(Symmetry symmetry_,Triangle triangle_ = Triangle::Lower);
         void uncompress() override;
+        //A = alpha*A, in parallel on the compressed values
+        Matrix& operator*=(const T& alpha);
         T norm(const algebra:: Typenorm& norm_)const override;
         friend std::vector<T> operator*<> (const Matrix<T, StorageOrder::RowMajor>& matrix, const std::vector<T>& vec);
         friend std::vector<T> algebra:: operator*<>(const Matrix<T, StorageOrder::RowMajor>& matrix, const Matrix<T,StorageOrder::RowMajor>& vec);
         //std::vector<T> matrixVectorProduct(const std::vector<T>& vec) const override;
         friend void read<>(Matrix<T, StorageOrder::RowMajor>& matrix,const std::string& file_name);
+        friend Matrix<T,StorageOrder::RowMajor> add<>(const T& alpha,const Matrix<T,StorageOrder::RowMajor>& A,const T& beta,const Matrix<T,StorageOrder::RowMajor>& B);
+        friend Matrix<T,StorageOrder::RowMajor> extract<>(const Matrix<T,StorageOrder::RowMajor>& matrix,const std::vector<std::size_t>& rowSet,const std::vector<std::size_t>& colSet);
         void print() const override;
+        //prints the stored elements as lines "row col value" (0-based), in O(nonZeros())
+        void print_triplets(std::ostream& os = std::cout)const;
     };
     //this struct is used for overload the operator < of the map 
     //that stores the no zero element of the matrix. And so define a ColumMajor sparse matrix
@@ -80,32 +316,163 @@ namespace algebra {
     class Matrix<T, StorageOrder::ColumnMajor> : public SparseMatrixBase<T> {
     private:
         std::map<std::array<std::size_t, 2>, T, ColumnMajorComparator> elements;
-        std::vector<std::vector<std::pair<std::size_t,T>>> compressedMatrix;
+        //Compressed (CSC) format, the index structure can be shared with other matrices
+        PatternPtr<StorageOrder::ColumnMajor> pattern_;
+        //Only the vectors of the precision are used (values, reducedValues or the split parts)
+        parallel::first_touch_vector<T> values;
+        parallel::first_touch_vector<ReducedPrecision_t<T>> reducedValues;
+        parallel::first_touch_vector<RealType_t<T>> realValues;
+        parallel::first_touch_vector<RealType_t<T>> imagValues;
+        //writes the values with the split of the pattern, so every thread touches first its part:
+        //fill(begin,end,store) calls store(k,value) for the positions k of the outer indexes [begin,end)
+        //of a block, the value is stored with the precision of the matrix. The index arrays can be
+        //written in the same pass
+        template<typename F>
+        void assign_outer(F&& fill){
+            const std::size_t size = pattern_->outerIndex.back();
+            auto run = [&](auto&& store){
+                pattern_->for_each_outer([&](std::size_t,std::size_t begin,std::size_t end){
+                    fill(begin,end,store);
+                });
+            };
+            if(precision == StoragePrecision::Full){
+                parallel::resize(values,size);
+                run([this](std::size_t k,const T& value){values[k] = value;});
+            }else if(precision == StoragePrecision::Reduced){
+                parallel::resize(reducedValues,size);
+                run([this](std::size_t k,const T& value){reducedValues[k] = static_cast<ReducedPrecision_t<T>>(value);});
+            }else{
+                parallel::resize(realValues,size);
+                parallel::resize(imagValues,size);
+                run([this](std::size_t k,const T& value){
+                    realValues[k] = std::real(value);
+                    imagValues[k] = std::imag(value);
+                });
+            }
+        }
+        //sets the values to value(k) for the position k, stored with the precision of the matrix
+        template<typename F>
+        void assign_values(F&& value){
+            assign_outer([this,&value](std::size_t begin,std::size_t end,auto&& store){
+                for(std::size_t k=pattern_->outerIndex[begin];k<pattern_->outerIndex[end];++k){
+                    store(k,value(k));
+                }
+            });
+        }
+        StoragePrecision precision;
+        //kernel of the product, chosen at compress() from the structure of the pattern
+        SpMVKernel spmvKernel = SpMVKernel::RowByRow;
+        //chooses spmvKernel for a new pattern (with the autotuning, if enabled), once the values
+        //and the symmetry are set
+        void select_kernel();
         std::size_t numRows;
         std::size_t numCols;
         bool isCompressed;
+        Symmetry symmetryType;
+        Triangle storedTriangle;
+        bool in_stored_triangle(std::size_t row,std::size_t col)const{
+            return storedTriangle == Triangle::Lower ? row >= col : row <= col;
+        };
+        //value of the element (row,col), also when it is obtained by symmetry. Empty if not stored
+        std::optional<T> find(std::size_t row,std::size_t col)const;
+        T symmetric_norm(const algebra::Typenorm& norm_)const;
+        //tag of the constructor that leaves the values to the caller
+        struct ValuesLater {};
+        //compressed matrix on pattern without values and without checking the triangle: the caller
+        //writes the values (with assign_values or assign_outer) and then calls select_kernel
+        Matrix(PatternPtr<StorageOrder::ColumnMajor> pattern,StoragePrecision precision_,Symmetry symmetry_,Triangle triangle_,ValuesLater);
     public:
         // Declaration for colum major
         Matrix(std::size_t nrow,std::size_t ncol);
+        //compressed matrix with all the values equal to zero on an existing pattern, the values are
+        //then assembled without any index work with set_values, or with operator() if the precision is Full.
+        //The kernel is the cached or the analyzed one, autotune() can be called once assembled
+        //A symmetric (Hermitian) matrix needs a pattern with only the stored triangle, as the one of a
+        //symmetric matrix: Matrix(S.pattern(),S.storage_precision(),S.symmetry(),S.triangle())
+        explicit Matrix(PatternPtr<StorageOrder::ColumnMajor> pattern,StoragePrecision precision_ = StoragePrecision::Full,
+                        Symmetry symmetry_ = Symmetry::General,Triangle triangle_ = Triangle::Lower);
         bool is_compressed()const{return isCompressed;};
         void resize(std::size_t nrow,std::size_t ncol);
         T operator()(std::size_t row, std::size_t col) const override;
         T& operator()(std::size_t row, std::size_t col) override;
         void compress() override;
+        //compress storing the values with the given precision, a compressed matrix stores them
+        //again with it on its pattern
+        void compress(StoragePrecision precision_);
+        StoragePrecision storage_precision()const{return precision;};
+        SpMVKernel kernel()const{return spmvKernel;};
+        //forces the kernel of the product (Blocked only if the pattern has the runs)
+        void set_kernel(SpMVKernel kernel_);
+        std::size_t rows()const{return numRows;};
+        std::size_t cols()const{return numCols;};
+        std::size_t nonZeros()const{return isCompressed ? pattern_->nonZeros() : elements.size();};
+        //pattern of the compressed matrix, nullptr if the matrix is not compressed
+        const auto& pattern()const{return pattern_;};
+        //replace the values keeping the pattern, the values are given in the compressed order
+        void set_values(std::vector<T> newValues);
+        //stored elements of the column j of the compressed matrix, without copies
+        //(only one triangle for symmetric matrices, not available with reduced precision)
+        SparseVectorView<T> col(std::size_t j)const;
+        //Calls f with the vector of the stored values (values, reducedValues or SplitComplexValues),
+        //so that the kernels can be instantiated once per precision without branching in the inner loop
+        template<typename F>
+        decltype(auto) visit_values(F&& f)const{
+            if constexpr(Complex<T>){
+                if(precision == StoragePrecision::Split){
+                    return f(SplitComplexValues<RealType_t<T>>{realValues.data(),imagValues.data(),realValues.size()});
+                }
+            }
+            if(precision == StoragePrecision::Reduced){
+                return f(reducedValues);
+            }
+            return f(values);
+        }
+        //Calls f(row,col,value) for each stored element (only one triangle for symmetric matrices)
+        template<typename F>
+        void for_each_stored(F&& f)const{
+            if(!isCompressed){
+                for(const auto& [key,value] : elements){
+                    f(key[0],key[1],value);
+                }
+                return;
+            }
+            visit_values([&](const auto& vals){
+                for(std::size_t i=0;i+1<pattern_->outerIndex.size();++i){
+                    for(std::size_t k=pattern_->outerIndex[i];k<pattern_->outerIndex[i+1];++k){
+                        f(pattern_->innerIndex[k],i,static_cast<T>(vals[k]));
+                    }
+                }
+            });
+        }
+        Symmetry symmetry()const{return symmetryType;};
+        Triangle triangle()const{return storedTriangle;};
+        //set the symmetry of a not compressed matrix, the elements outside the stored triangle
+        //are moved in it (if the symmetric one is not already there)
+        void set_symmetry(Symmetry symmetry_,Triangle triangle_ = Triangle::Lower);
         void uncompress() override;
+        //A = alpha*A, in parallel on the compressed values
+        Matrix& operator*=(const T& alpha);
         T norm(const algebra::Typenorm& norm_)const override;
         friend void read<>(Matrix<T,StorageOrder::ColumnMajor>& matrix,const std::string& file_name);
+        friend Matrix<T,StorageOrder::ColumnMajor> add<>(const T& alpha,const Matrix<T,StorageOrder::ColumnMajor>& A,const T& beta,const Matrix<T,StorageOrder::ColumnMajor>& B);
+        friend Matrix<T,StorageOrder::ColumnMajor> extract<>(const Matrix<T,StorageOrder::ColumnMajor>& matrix,const std::vector<std::size_t>& rowSet,const std::vector<std::size_t>& colSet);
         friend std::vector<T> operator*<> (const Matrix<T, StorageOrder::ColumnMajor>& matrix, const std::vector<T>& vec);
         friend std::vector<T> operator*<> (const Matrix<T, StorageOrder::ColumnMajor>& matrix, const Matrix<T,StorageOrder::ColumnMajor>& vec);
         //std::vector<T> matrixVectorProduct(const std::vector<T>& vec) const override;
         void print() const override;
+        //prints the stored elements as lines "row col value" (0-based), in O(nonZeros())
+        void print_triplets(std::ostream& os = std::cout)const;
     };  
 
 
 }  // namespace algebra
 
 
+#include "SparsityPattern_impl.hpp" // Include the implementation of the shared pattern
 #include "SparseMatrix_impl.hpp"  // Include the implementation file for RowMajor
 #include "SparseMatrix_impl_col.hpp" //Include the implementation fil for ColumnMajor
 #include "SparseMatrxiOperator.hpp" //Include the Operator for the matrix
+#include "SparseMatrixPreconditioner.hpp" //Include the triangular solves and the incomplete factorizations
+#include "SparseMatrixSolvers.hpp" //Include the Krylov solvers
+#include "SparseMatrixStreaming.hpp" //Include the out of core matrix read from file
 #endif // SPARSEMATRIX_HPP
\ No newline at end of file
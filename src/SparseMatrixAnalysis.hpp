@@ -0,0 +1,117 @@
+#ifndef SPARSEMATRIXANALYSIS_HPP
+#define SPARSEMATRIXANALYSIS_HPP
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <optional>
+#include "SparseMatrixParallel.hpp"
+
+namespace algebra {
+
+    //precision of the stored values (defined in SparseMatrix.hpp), part of the key of the autotuning
+    enum class StoragePrecision;
+
+    //Kernel used by the product of a compressed RowMajor matrix (general symmetry), all of them
+    //sum the elements of a row in the same order, so they give the same result. The rows are split
+    //among the threads as the pattern (SparsityPattern::byElements for very different row lengths):
+    //RowByRow: one row after the other
+    //Sliced: 4 rows are walked together, as in the SELL format without padding (short rows of similar length)
+    //Blocked: the rows are walked by runs of consecutive columns, with a direct access to the vector (block structure)
+    enum class SpMVKernel { RowByRow, Sliced, Blocked };
+
+    //Structure of a pattern, computed when the pattern is built (SparsityPattern::analyze).
+    //The lengths are of the outer indexes: rows for RowMajor, columns for ColumnMajor
+    struct StructureInfo {
+        std::size_t minLength = 0;
+        std::size_t maxLength = 0;
+        double meanLength = 0;
+        //standard deviation of the lengths
+        double lengthDeviation = 0;
+        //max |row-col| of the stored elements
+        std::size_t bandwidth = 0;
+        //mean number of consecutive inner indexes in an outer (1 without block structure)
+        double meanRun = 0;
+        //hash of the sizes and of the index arrays, used as key of the autotuning cache
+        std::uint64_t fingerprint = 0;
+        //kernel chosen from the statistics above
+        SpMVKernel kernel = SpMVKernel::RowByRow;
+    };
+
+    //thresholds of the choice of the kernel
+    inline constexpr double blockedRun = 4;
+    inline constexpr double slicedLength = 16;
+
+    //Blocked only if the runs can be built (blocked false for the patterns of ColumnMajor or
+    //symmetric matrices, whose products do not use these kernels)
+    inline SpMVKernel choose_kernel(const StructureInfo& info,bool blocked){
+        if(blocked && info.meanRun >= blockedRun){
+            return SpMVKernel::Blocked;
+        }
+        if(info.meanLength <= slicedLength && info.lengthDeviation <= 0.25*info.meanLength){
+            return SpMVKernel::Sliced;
+        }
+        return SpMVKernel::RowByRow;
+    }
+}  // namespace algebra
+
+namespace algebra::tuning {
+
+    //The autotuning times the kernels on the matrix at compress() and keeps the fastest one.
+    //The result is cached with the fingerprint of the pattern, the number of threads and the
+    //precision of the values, so the matrices with the same pattern (or compressed again) do not
+    //repeat the trial. The settings can be changed while other threads compress
+    struct TuningSettings {
+        std::atomic<bool> autotune = false;
+        //products timed for each kernel
+        std::atomic<std::size_t> trials = 3;
+        std::mutex mutex;
+        std::map<std::array<std::uint64_t,3>,SpMVKernel> cache;
+    };
+    inline TuningSettings& settings(){
+        static TuningSettings instance;
+        return instance;
+    }
+
+    inline bool autotuning(){return settings().autotune;}
+    inline std::size_t trials(){return settings().trials;}
+    //off by default: the trial costs some products at every compress() of a new pattern
+    inline void set_autotuning(bool autotune,std::size_t trials = 3){
+        settings().autotune = autotune;
+        settings().trials = std::max<std::size_t>(1,trials);
+    }
+
+    inline std::array<std::uint64_t,3> cache_key(std::uint64_t fingerprint,StoragePrecision precision){
+        return {fingerprint,parallel::num_threads(),static_cast<std::uint64_t>(precision)};
+    }
+    inline std::optional<SpMVKernel> cached(std::uint64_t fingerprint,StoragePrecision precision){
+        auto& s = settings();
+        std::lock_guard lock(s.mutex);
+        auto it = s.cache.find(cache_key(fingerprint,precision));
+        if(it == s.cache.end()){
+            return std::nullopt;
+        }
+        return it->second;
+    }
+    inline void store(std::uint64_t fingerprint,StoragePrecision precision,SpMVKernel kernel){
+        auto& s = settings();
+        std::lock_guard lock(s.mutex);
+        s.cache[cache_key(fingerprint,precision)] = kernel;
+    }
+    inline void clear_cache(){
+        auto& s = settings();
+        std::lock_guard lock(s.mutex);
+        s.cache.clear();
+    }
+
+    //kernel for a pattern: the tuned one if it is in the cache, otherwise the one of the analysis.
+    //A cached Blocked is not used by a pattern without the runs (hasRuns false)
+    inline SpMVKernel select_kernel(const StructureInfo& info,StoragePrecision precision,bool hasRuns){
+        const SpMVKernel kernel = cached(info.fingerprint,precision).value_or(info.kernel);
+        return kernel == SpMVKernel::Blocked && !hasRuns ? info.kernel : kernel;
+    }
+}  // namespace algebra::tuning
+
+#endif // SPARSEMATRIXANALYSIS_HPP
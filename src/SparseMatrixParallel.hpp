@@ -0,0 +1,440 @@
+#ifndef SPARSEMATRIXPARALLEL_HPP
+#define SPARSEMATRIXPARALLEL_HPP
+#include <thread>
+#include <vector>
+#include <deque>
+#include <cstddef>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <type_traits>
+#include <limits>
+#include <concepts>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace algebra::parallel {
+
+    //minimum number of outer indexes (rows or columns) given to a thread,
+    //below it the kernels run on the calling thread only
+    inline constexpr std::size_t grain = 2048;
+
+    //Persistent pool of threads used by the kernels. The worker w has its own queue, so the
+    //chunk c of for_each_chunk is run by the worker c: the memory touched first by a chunk
+    //(see first_touch) is on the NUMA node of the thread that will use it in the kernels.
+    //The queue of a worker busy with another task (a long async task, a blocked one) is not
+    //left waiting: the idle workers and the threads in wait take its tasks not yet started.
+    //The workers can be pinned each to a cpu of the process (in the order of its affinity mask),
+    //so they are not moved by the scheduler
+    class ThreadPool {
+    public:
+        ThreadPool(std::size_t numWorkers,bool pinned);
+        ~ThreadPool();
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+        std::size_t size()const{return workers.size();};
+        //runs the task on the worker w
+        void run_on(std::size_t w,std::function<void()> task);
+        //runs the task on the first free worker
+        void submit(std::function<void()> task);
+        //blocks until done() is true (it is checked with the lock of the pool held).
+        //The waiting thread runs in the meantime the tasks of its queue (if it is a worker) and
+        //those queued to busy workers, so the nested calls of for_each_chunk can not deadlock
+        template<typename Pred>
+        void wait(Pred done);
+        //notifies the waiting threads after a change of the state checked by wait, f is run with the lock held
+        template<typename F>
+        void notify(F&& f);
+        //true on the threads of the pool
+        static bool in_worker(){return current != std::numeric_limits<std::size_t>::max();}
+    private:
+        using Queue = std::deque<std::function<void()>>;
+        //cpu is the one of the worker, -1 if it is not pinned
+        void work(std::size_t w,int cpu);
+        //cpus the process can run on (its affinity mask, as taskset, cgroups or MPI set it)
+        static std::vector<int> allowed_cpus();
+        //with the lock held: a queue of a busy worker with tasks, nullptr if there is none
+        Queue* stealable();
+        static std::function<void()> pop(Queue& queue);
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::vector<Queue> queues;
+        //busy[w] is true while the worker w runs a task
+        std::vector<char> busy;
+        std::deque<std::function<void()>> shared;
+        bool stop = false;
+        std::vector<std::jthread> workers;
+        //index of the worker run by the current thread, npos for the other threads
+        static inline thread_local std::size_t current = std::numeric_limits<std::size_t>::max();
+    };
+
+    inline ThreadPool::ThreadPool(std::size_t numWorkers,bool pinned): queues(numWorkers),busy(numWorkers,false){
+        const std::vector<int> cpus = pinned ? allowed_cpus() : std::vector<int>{};
+        workers.reserve(numWorkers);
+        for(std::size_t w=0;w<numWorkers;++w){
+            //more workers than cpus: they are placed round robin on the allowed ones
+            const int cpu = cpus.empty() ? -1 : cpus[w % cpus.size()];
+            workers.emplace_back([this,w,cpu](){work(w,cpu);});
+        }
+    }
+
+    inline std::vector<int> ThreadPool::allowed_cpus(){
+        std::vector<int> cpus;
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if(sched_getaffinity(0,sizeof(set),&set) == 0){
+            for(int cpu=0;cpu<CPU_SETSIZE;++cpu){
+                if(CPU_ISSET(cpu,&set)){
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+#endif
+        return cpus;
+    }
+
+    inline ThreadPool::~ThreadPool(){
+        //the workers complete their queues before stopping
+        notify([this](){stop = true;});
+        workers.clear();
+    }
+
+    inline void ThreadPool::work(std::size_t w,int cpu){
+        current = w;
+#ifdef __linux__
+        if(cpu >= 0){
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu,&set);
+            pthread_setaffinity_np(pthread_self(),sizeof(set),&set);
+        }
+#else
+        (void)cpu;
+#endif
+        std::unique_lock lock(mutex);
+        while(true){
+            //own queue first, then the chunks left by the busy workers, then the async tasks
+            Queue* queue = nullptr;
+            condition.wait(lock,[this,w,&queue](){
+                queue = !queues[w].empty() ? &queues[w] : stealable();
+                if(!queue && !shared.empty()){
+                    queue = &shared;
+                }
+                return stop || queue;
+            });
+            if(!queue){
+                return;
+            }
+            auto task = pop(*queue);
+            busy[w] = true;
+            //the tasks left in the queue can now be taken by the others
+            const bool left = !queues[w].empty();
+            lock.unlock();
+            if(left){
+                condition.notify_all();
+            }
+            task();
+            lock.lock();
+            busy[w] = false;
+        }
+    }
+
+    inline ThreadPool::Queue* ThreadPool::stealable(){
+        for(std::size_t v=0;v<queues.size();++v){
+            if(busy[v] && !queues[v].empty()){
+                return &queues[v];
+            }
+        }
+        return nullptr;
+    }
+
+    inline std::function<void()> ThreadPool::pop(Queue& queue){
+        auto task = std::move(queue.front());
+        queue.pop_front();
+        return task;
+    }
+
+    inline void ThreadPool::run_on(std::size_t w,std::function<void()> task){
+        notify([&](){queues[w].push_back(std::move(task));});
+    }
+
+    inline void ThreadPool::submit(std::function<void()> task){
+        notify([&](){shared.push_back(std::move(task));});
+    }
+
+    template<typename Pred>
+    void ThreadPool::wait(Pred done){
+        std::unique_lock lock(mutex);
+        while(!done()){
+            //the async tasks are not taken here, they could keep the thread for long
+            Queue* queue = current < queues.size() && !queues[current].empty() ? &queues[current] : stealable();
+            if(queue){
+                auto task = pop(*queue);
+                lock.unlock();
+                task();
+                lock.lock();
+            }else{
+                condition.wait(lock);
+            }
+        }
+    }
+
+    template<typename F>
+    void ThreadPool::notify(F&& f){
+        {
+            std::lock_guard lock(mutex);
+            f();
+        }
+        condition.notify_all();
+    }
+
+    //The pool is built at the first parallel call, that can come at the same time from several
+    //threads (the products of multiply_async, the kernels called by different user threads):
+    //mutex guards its creation and its replacement
+    struct PoolSettings {
+        std::atomic<std::size_t> numThreads = std::max<std::size_t>(1,std::thread::hardware_concurrency());
+        std::atomic<bool> pinned = false;
+        std::mutex mutex;
+        std::unique_ptr<ThreadPool> pool;
+    };
+    inline PoolSettings& settings(){
+        static PoolSettings instance;
+        return instance;
+    }
+
+    //number of threads used by the parallel kernels (the calling thread and num_threads()-1 workers)
+    inline std::size_t num_threads(){return settings().numThreads;}
+    //the pool is rebuilt at the next parallel call. These must be called before the kernels or
+    //when none is running (on any thread): a running kernel uses the old pool and number of threads
+    inline void set_num_threads(std::size_t n){
+        auto& s = settings();
+        std::lock_guard lock(s.mutex);
+        s.numThreads = std::max<std::size_t>(1,n);
+        s.pool.reset();
+    }
+    inline bool thread_pinning(){return settings().pinned;}
+    //pins the worker w to the w-th cpu of the affinity mask of the process, taken when the
+    //pool is built (only on Linux, elsewhere it has no effect)
+    inline void set_thread_pinning(bool pinned){
+        auto& s = settings();
+        std::lock_guard lock(s.mutex);
+        s.pinned = pinned;
+        s.pool.reset();
+    }
+    inline ThreadPool& pool(){
+        auto& s = settings();
+        std::lock_guard lock(s.mutex);
+        if(!s.pool){
+            s.pool = std::make_unique<ThreadPool>(s.numThreads-1,s.pinned);
+        }
+        return *s.pool;
+    }
+
+    //number of chunks used by for_each_chunk for n elements (at most num_threads())
+    inline std::size_t chunks(std::size_t n){
+        return std::clamp<std::size_t>(n/grain,1,num_threads());
+    }
+
+    //Splits [0,n) in chunks() contiguous blocks and calls f(chunk,begin,end) on each of them.
+    //The chunk c is run by the worker c of the pool and the last one by the calling thread,
+    //so the same n is always split in the same way among the same threads. If the worker c is
+    //busy with another task its chunk is run by an idle thread: the blocks do not change.
+    //The first exception thrown by a chunk is rethrown once all the chunks are completed
+    template<typename F>
+    void for_each_chunk(std::size_t n,F&& f){
+        const std::size_t nchunks = chunks(n);
+        const std::size_t size = n/nchunks, rest = n%nchunks;
+        auto begin = [size,rest](std::size_t c){return c*size + std::min(c,rest);};
+        if(nchunks == 1){
+            f(0,0,n);
+            return;
+        }
+        ThreadPool& workers = pool();
+        std::size_t remaining = nchunks-1;
+        std::exception_ptr error;
+        std::mutex errorMutex;
+        auto run = [&](std::size_t c,std::size_t b,std::size_t e){
+            try{
+                f(c,b,e);
+            }catch(...){
+                std::lock_guard lock(errorMutex);
+                if(!error){
+                    error = std::current_exception();
+                }
+            }
+        };
+        for(std::size_t c=0;c+1<nchunks;++c){
+            workers.run_on(c,[&,c,b=begin(c),e=begin(c+1)](){
+                run(c,b,e);
+                workers.notify([&remaining](){--remaining;});
+            });
+        }
+        run(nchunks-1,begin(nchunks-1),n);
+        workers.wait([&remaining](){return remaining == 0;});
+        if(error){
+            std::rethrow_exception(error);
+        }
+    }
+
+    //Reduction on [0,n): f(begin,end) returns the partial result of a chunk, the partial
+    //results are combined in order with combine, so the result does not depend on the scheduling
+    template<typename R,typename F,typename Combine = std::plus<>>
+    R reduce(std::size_t n,R init,F&& f,Combine combine = {}){
+        std::vector<R> partial(chunks(n),init);
+        for_each_chunk(n,[&](std::size_t chunk,std::size_t begin,std::size_t end){
+            partial[chunk] = f(begin,end);
+        });
+        for(const auto& value : partial){
+            init = combine(init,value);
+        }
+        return init;
+    }
+
+    //Runs f() on a worker of the pool and returns the future of its result, so the calling thread
+    //can do other work in the meantime. While f runs its worker is busy: the chunks queued to it,
+    //by the kernels called from f or by other threads, are run by the idle workers or by the
+    //thread waiting for them. Without workers (num_threads() == 1) and from a task of the pool
+    //f is run before returning: a worker waiting on the future would not run the queued task
+    template<typename F>
+    std::future<std::invoke_result_t<F>> async(F&& f){
+        auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::forward<F>(f));
+        auto result = task->get_future();
+        ThreadPool& workers = pool();
+        if(workers.size() == 0 || ThreadPool::in_worker()){
+            (*task)();
+        }else{
+            workers.submit([task](){(*task)();});
+        }
+        return result;
+    }
+
+    //Allocator that leaves the elements default initialized (not zeroed) on resize: the pages
+    //are then touched first, and so placed on the NUMA node, by the thread that fills them.
+    //Types with a default constructor that writes (std::complex) are still zeroed on resize
+    template<typename U>
+    struct FirstTouchAllocator : std::allocator<U> {
+        using value_type = U;
+        FirstTouchAllocator() = default;
+        template<typename V>
+        FirstTouchAllocator(const FirstTouchAllocator<V>&) noexcept {}
+        template<typename V>
+        struct rebind { using other = FirstTouchAllocator<V>; };
+        template<typename V>
+        void construct(V* p) noexcept(std::is_nothrow_default_constructible_v<V>){
+            ::new(static_cast<void*>(p)) V;
+        }
+        template<typename V,typename... Args>
+        void construct(V* p,Args&&... args){
+            ::new(static_cast<void*>(p)) V(std::forward<Args>(args)...);
+        }
+    };
+    template<typename U,typename V>
+    bool operator==(const FirstTouchAllocator<U>&,const FirstTouchAllocator<V>&){return true;}
+
+    template<typename U>
+    using first_touch_vector = std::vector<U,FirstTouchAllocator<U>>;
+
+    //Vectors accepted by the kernels and the solvers: the work vectors of the library are
+    //first_touch_vector, the ones of the user can be std::vector
+    template<typename V,typename U>
+    concept VectorOf = std::same_as<V,std::vector<U>> || std::same_as<V,first_touch_vector<U>>;
+
+    //Resizes vec to n elements without keeping the old ones, so a first_touch_vector is not
+    //touched (its elements are written first by the kernels)
+    template<typename Vector>
+    void resize(Vector& vec,std::size_t n){
+        if(vec.size() != n){
+            vec.clear();
+            vec.resize(n);
+        }
+    }
+
+    //Resizes vec to n elements equal to value, written with the split of for_each_chunk(n)
+    //used by the vector operations
+    template<typename Vector,typename U>
+    void fill(Vector& vec,std::size_t n,const U& value){
+        resize(vec,n);
+        for_each_chunk(n,[&](std::size_t,std::size_t begin,std::size_t end){
+            std::fill(vec.begin()+begin,vec.begin()+end,value);
+        });
+    }
+
+    //dst = src, written with the split of for_each_chunk
+    template<typename Dst,typename Src>
+    void copy(Dst& dst,const Src& src){
+        resize(dst,src.size());
+        for_each_chunk(src.size(),[&](std::size_t,std::size_t begin,std::size_t end){
+            std::copy(src.begin()+begin,src.begin()+end,dst.begin()+begin);
+        });
+    }
+
+    //Split of the outer indexes of compressed arrays (the outer i has the positions
+    //[outerIndex[i],outerIndex[i+1])), used both to fill the arrays and by the kernels, so every
+    //thread works on the memory it touched first. The outer indexes are split evenly, or with
+    //byElements so that the threads have the same number of positions (for very different
+    //lengths): a thread takes the outer indexes that start in its block of positions.
+    //Calls f(chunk,begin,end) for each block [begin,end) of outer indexes
+    template<typename Index,typename F>
+    void for_each_outer(const Index& outerIndex,bool byElements,F&& f){
+        const std::size_t numOuter = outerIndex.size()-1;
+        if(!byElements){
+            for_each_chunk(numOuter,std::forward<F>(f));
+            return;
+        }
+        const std::size_t numPositions = outerIndex.back();
+        const auto first = outerIndex.cbegin(), last = outerIndex.cend()-1;
+        for_each_chunk(numPositions,[&](std::size_t chunk,std::size_t begin,std::size_t end){
+            const auto outerBegin = static_cast<std::size_t>(std::lower_bound(first,last,begin)-first);
+            //the empty outer indexes at the end go to the last block
+            const auto outerEnd = end == numPositions ? numOuter : static_cast<std::size_t>(std::lower_bound(first,last,end)-first);
+            f(chunk,outerBegin,outerEnd);
+        });
+    }
+
+    //number of blocks of for_each_outer
+    template<typename Index>
+    std::size_t outer_chunks(const Index& outerIndex,bool byElements){
+        return chunks(byElements ? outerIndex.back() : outerIndex.size()-1);
+    }
+
+    //reduce on the blocks of for_each_outer, f(begin,end) gets the outer indexes of a block
+    template<typename R,typename Index,typename F,typename Combine = std::plus<>>
+    R reduce_outer(const Index& outerIndex,bool byElements,R init,F&& f,Combine combine = {}){
+        std::vector<R> partial(outer_chunks(outerIndex,byElements),init);
+        for_each_outer(outerIndex,byElements,[&](std::size_t chunk,std::size_t begin,std::size_t end){
+            partial[chunk] = f(begin,end);
+        });
+        for(const auto& value : partial){
+            init = combine(init,value);
+        }
+        return init;
+    }
+
+    //Calls f(k) for the positions k of the compressed arrays, with the split of for_each_outer
+    template<typename Index,typename F>
+    void for_each_position(const Index& outerIndex,bool byElements,F&& f){
+        for_each_outer(outerIndex,byElements,[&](std::size_t,std::size_t begin,std::size_t end){
+            for(std::size_t k=outerIndex[begin];k<outerIndex[end];++k){
+                f(k);
+            }
+        });
+    }
+
+    //Resizes vec to outerIndex.back() elements and sets vec[k] = value(k) with for_each_position,
+    //so every thread touches first its own part
+    template<typename U,typename Index,typename F>
+    void first_touch(first_touch_vector<U>& vec,const Index& outerIndex,bool byElements,F&& value){
+        resize(vec,outerIndex.back());
+        for_each_position(outerIndex,byElements,[&](std::size_t k){vec[k] = value(k);});
+    }
+}  // namespace algebra::parallel
+
+#endif // SPARSEMATRIXPARALLEL_HPP
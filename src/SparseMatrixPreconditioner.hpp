@@ -0,0 +1,316 @@
+#ifndef SPARSEMATRIXPRECONDITIONER_HPP
+#define SPARSEMATRIXPRECONDITIONER_HPP
+#include "SparseMatrix.hpp"
+
+namespace algebra {
+
+    //Analysis of a triangular solve with the triangle of a compressed matrix (or with its
+    //conjugate transpose). The unknowns are grouped in levels: an unknown depends only on
+    //the unknowns of the previous levels, so the ones of the same level are computed in parallel.
+    //The schedule depends only on the pattern, so it is reused for all the matrices that share it
+    template<StorageOrder Order>
+    class TriangularSchedule {
+    private:
+        //analysed pattern, the matrices of solve must have it
+        PatternPtr<Order> pattern_;
+        Triangle triangle_;
+        bool conjugateTranspose_;
+        //position of the diagonal element of each unknown, nonZeros() if it is not stored
+        std::vector<std::size_t> diagonal_;
+        //off diagonal elements used by each unknown: positions in the values and unknowns
+        std::vector<std::size_t> entryPtr_;
+        std::vector<std::size_t> entryPos_;
+        std::vector<std::size_t> entryCol_;
+        //the level l has the unknowns order_[levelPtr_[l]:levelPtr_[l+1]]
+        std::vector<std::size_t> levelPtr_;
+        std::vector<std::size_t> order_;
+    public:
+        TriangularSchedule(PatternPtr<Order> pattern,Triangle triangle,bool conjugateTranspose = false);
+        Triangle triangle()const{return triangle_;};
+        bool conjugate_transpose()const{return conjugateTranspose_;};
+        std::size_t size()const{return diagonal_.size();};
+        std::size_t levels()const{return levelPtr_.size()-1;};
+        //Solves op(T) x = b, with T the triangle of the compressed matrix and op the identity or
+        //the conjugate transpose. With unitDiagonal the diagonal is taken equal to one.
+        //The unknowns of each level are computed in parallel
+        template<ScalarOrComplex T,parallel::VectorOf<T> B = std::vector<T>,parallel::VectorOf<T> X>
+        void solve(const Matrix<T,Order>& matrix,const B& b,X& x,bool unitDiagonal = false)const;
+    };
+
+    template<StorageOrder Order>
+    TriangularSchedule<Order>::TriangularSchedule(PatternPtr<Order> patternPtr,Triangle triangle,bool conjugateTranspose):
+        pattern_(std::move(patternPtr)),triangle_(triangle),conjugateTranspose_(conjugateTranspose){
+        if(!pattern_){
+            throw std::invalid_argument("The pattern is empty");
+        }
+        const auto& pattern = *pattern_;
+        if(pattern.numRows != pattern.numCols){
+            throw std::invalid_argument("The triangular matrix must be square");
+        }
+        const std::size_t n = pattern.numRows;
+        //the unknown i of op(matrix) uses the row i of the matrix, or the column i if transposed
+        EntryLists lists = entry_lists(pattern,!conjugateTranspose);
+        //op(matrix) is lower triangular if the triangle is lower and it is not transposed (or viceversa)
+        const bool lower = (triangle == Triangle::Lower) != conjugateTranspose;
+        diagonal_.assign(n,pattern.nonZeros());
+        entryPtr_.assign(n+1,0);
+        for(std::size_t i=0;i<n;++i){
+            for(std::size_t e=lists.ptr[i];e<lists.ptr[i+1];++e){
+                const std::size_t j = lists.index[e];
+                if(j == i){
+                    diagonal_[i] = lists.pos[e];
+                }else if(lower ? j < i : j > i){
+                    entryPos_.push_back(lists.pos[e]);
+                    entryCol_.push_back(j);
+                }
+            }
+            entryPtr_[i+1] = entryPos_.size();
+        }
+        //level of an unknown: one more than the highest level of the unknowns it uses
+        std::vector<std::size_t> level(n,0);
+        std::size_t numLevels = n == 0 ? 0 : 1;
+        for(std::size_t step=0;step<n;++step){
+            const std::size_t i = lower ? step : n-1-step;
+            for(std::size_t e=entryPtr_[i];e<entryPtr_[i+1];++e){
+                level[i] = std::max(level[i],level[entryCol_[e]]+1);
+            }
+            numLevels = std::max(numLevels,level[i]+1);
+        }
+        levelPtr_.assign(numLevels+1,0);
+        for(auto l : level){
+            ++levelPtr_[l+1];
+        }
+        std::partial_sum(levelPtr_.cbegin(),levelPtr_.cend(),levelPtr_.begin());
+        order_.resize(n);
+        std::vector<std::size_t> next(levelPtr_.cbegin(),levelPtr_.cend()-1);
+        for(std::size_t i=0;i<n;++i){
+            order_[next[level[i]]++] = i;
+        }
+    }
+
+    template<StorageOrder Order>
+    template<ScalarOrComplex T,parallel::VectorOf<T> B,parallel::VectorOf<T> X>
+    void TriangularSchedule<Order>::solve(const Matrix<T,Order>& matrix,const B& b,X& x,bool unitDiagonal)const{
+        if(!matrix.is_compressed() || matrix.pattern() != pattern_ || b.size() != matrix.rows()){
+            throw std::invalid_argument("The matrix, the schedule and the vector are not coherent");
+        }
+        const std::size_t missing = matrix.nonZeros();
+        if(!unitDiagonal && std::find(diagonal_.cbegin(),diagonal_.cend(),missing) != diagonal_.cend()){
+            throw std::runtime_error("Zero on the diagonal of the triangular matrix");
+        }
+        parallel::resize(x,b.size());
+        const bool conj = conjugateTranspose_;
+        matrix.visit_values([&](const auto& vals){
+            auto coefficient = [&vals,conj](std::size_t k){
+                const T value = static_cast<T>(vals[k]);
+                return conj ? conjugate(value) : value;
+            };
+            for(std::size_t l=0;l<levels();++l){
+                const std::size_t first = levelPtr_[l];
+                parallel::for_each_chunk(levelPtr_[l+1]-first,[&](std::size_t,std::size_t begin,std::size_t end){
+                    for(std::size_t s=first+begin;s<first+end;++s){
+                        const std::size_t i = order_[s];
+                        T sum = b[i];
+                        for(std::size_t e=entryPtr_[i];e<entryPtr_[i+1];++e){
+                            sum -= coefficient(entryPos_[e])*x[entryCol_[e]];
+                        }
+                        x[i] = unitDiagonal ? sum : sum/coefficient(diagonal_[i]);
+                    }
+                });
+            }
+        });
+    }
+
+    template<ScalarOrComplex T,StorageOrder Order,parallel::VectorOf<T> B = std::vector<T>,parallel::VectorOf<T> X>
+    void triangular_solve(const Matrix<T,Order>& matrix,const TriangularSchedule<Order>& schedule,
+                          const B& b,X& x,bool unitDiagonal = false){
+        schedule.solve(matrix,b,x,unitDiagonal);
+    }
+
+    //Triangular solve without a precomputed schedule
+    template<ScalarOrComplex T,StorageOrder Order,parallel::VectorOf<T> B = std::vector<T>,parallel::VectorOf<T> X>
+    void triangular_solve(const Matrix<T,Order>& matrix,Triangle triangle,const B& b,X& x,bool unitDiagonal = false){
+        if(!matrix.is_compressed()){
+            throw std::invalid_argument("The matrix must be compressed");
+        }
+        triangular_solve(matrix,TriangularSchedule<Order>(matrix.pattern(),triangle),b,x,unitDiagonal);
+    }
+
+    //Incomplete LU factorization without fill in: L (unit diagonal) and U are stored together
+    //in a matrix that shares the pattern of A. factorize can be called again with any matrix
+    //with the same pattern, the schedules of the solves are computed only once
+    template<ScalarOrComplex T,StorageOrder Order>
+    class ILU0 {
+    private:
+        Matrix<T,Order> factors;
+        EntryLists rows_;
+        TriangularSchedule<Order> lower;
+        TriangularSchedule<Order> upper;
+        //result of the first solve of apply, kept between the calls (apply is not thread safe)
+        mutable parallel::first_touch_vector<T> work;
+    public:
+        explicit ILU0(const Matrix<T,Order>& A);
+        void factorize(const Matrix<T,Order>& A);
+        //z = U^-1 L^-1 r
+        template<parallel::VectorOf<T> R = std::vector<T>,parallel::VectorOf<T> Z>
+        void apply(const R& r,Z& z)const;
+        const Matrix<T,Order>& factor()const{return factors;};
+    };
+
+    template<ScalarOrComplex T,StorageOrder Order>
+    ILU0<T,Order>::ILU0(const Matrix<T,Order>& A):
+        factors(A.is_compressed() ? A.pattern() : nullptr),
+        rows_(entry_lists(*A.pattern(),true)),
+        lower(A.pattern(),Triangle::Lower),
+        upper(A.pattern(),Triangle::Upper){
+        factorize(A);
+    }
+
+    template<ScalarOrComplex T,StorageOrder Order>
+    void ILU0<T,Order>::factorize(const Matrix<T,Order>& A){
+        if(A.pattern() != factors.pattern() || A.symmetry() != Symmetry::General){
+            throw std::invalid_argument("ILU0 requires a compressed general matrix with the pattern of the factorization");
+        }
+        std::vector<T> lu(A.nonZeros());
+        //indexed access: the split complex values have no iterators
+        A.visit_values([&lu](const auto& vals){
+            for(std::size_t k=0;k<vals.size();++k){
+                lu[k] = static_cast<T>(vals[k]);
+            }
+        });
+        const std::size_t n = A.rows();
+        //position in lu of the elements of the current row, missing if not in the pattern
+        const std::size_t missing = lu.size();
+        std::vector<std::size_t> where(n,missing);
+        std::vector<std::size_t> diagonal(n,missing);
+        //IKJ variant: the row i is updated with the rows k < i already factorized
+        for(std::size_t i=0;i<n;++i){
+            for(std::size_t e=rows_.ptr[i];e<rows_.ptr[i+1];++e){
+                where[rows_.index[e]] = rows_.pos[e];
+            }
+            for(std::size_t e=rows_.ptr[i];e<rows_.ptr[i+1] && rows_.index[e] < i;++e){
+                const std::size_t k = rows_.index[e];
+                if(diagonal[k] == missing || lu[diagonal[k]] == static_cast<T>(0)){
+                    throw std::runtime_error("ILU0: zero pivot");
+                }
+                const T factor = lu[rows_.pos[e]] /= lu[diagonal[k]];
+                for(std::size_t f=rows_.ptr[k];f<rows_.ptr[k+1];++f){
+                    const std::size_t j = rows_.index[f];
+                    if(j > k && where[j] != missing){
+                        lu[where[j]] -= factor*lu[rows_.pos[f]];
+                    }
+                }
+            }
+            diagonal[i] = where[i];
+            for(std::size_t e=rows_.ptr[i];e<rows_.ptr[i+1];++e){
+                where[rows_.index[e]] = missing;
+            }
+        }
+        factors.set_values(std::move(lu));
+    }
+
+    template<ScalarOrComplex T,StorageOrder Order>
+    template<parallel::VectorOf<T> R,parallel::VectorOf<T> Z>
+    void ILU0<T,Order>::apply(const R& r,Z& z)const{
+        triangular_solve(factors,lower,r,work,true);
+        triangular_solve(factors,upper,work,z);
+    }
+
+    //Incomplete Cholesky factorization without fill in of a symmetric (Hermitian) positive
+    //definite matrix stored as one triangle: A ~ L L^H. The factor shares the pattern of A and
+    //keeps its triangle, so with the upper triangle it stores L^H
+    template<ScalarOrComplex T,StorageOrder Order>
+    class IC0 {
+    private:
+        Matrix<T,Order> factors;
+        Triangle triangle_;
+        //stored elements of each row of L
+        EntryLists rows_;
+        //schedules for L y = r and L^H z = y
+        TriangularSchedule<Order> forward;
+        TriangularSchedule<Order> backward;
+        //result of the first solve of apply, kept between the calls (apply is not thread safe)
+        mutable parallel::first_touch_vector<T> work;
+    public:
+        explicit IC0(const Matrix<T,Order>& A);
+        void factorize(const Matrix<T,Order>& A);
+        //z = L^-H L^-1 r
+        template<parallel::VectorOf<T> R = std::vector<T>,parallel::VectorOf<T> Z>
+        void apply(const R& r,Z& z)const;
+        const Matrix<T,Order>& factor()const{return factors;};
+    };
+
+    template<ScalarOrComplex T,StorageOrder Order>
+    IC0<T,Order>::IC0(const Matrix<T,Order>& A):
+        factors(A.is_compressed() ? A.pattern() : nullptr),
+        triangle_(A.triangle()),
+        //the rows of L are the rows of the lower triangle or the columns of the upper one
+        rows_(entry_lists(*A.pattern(),A.triangle() == Triangle::Lower)),
+        forward(A.pattern(),A.triangle(),A.triangle() == Triangle::Upper),
+        backward(A.pattern(),A.triangle(),A.triangle() == Triangle::Lower){
+        factorize(A);
+    }
+
+    template<ScalarOrComplex T,StorageOrder Order>
+    void IC0<T,Order>::factorize(const Matrix<T,Order>& A){
+        //L L^H is Hermitian: a complex symmetric (not Hermitian) matrix can not be factorized so
+        const bool symmetric = Complex<T> ? A.symmetry() == Symmetry::Hermitian : A.symmetry() != Symmetry::General;
+        if(A.pattern() != factors.pattern() || !symmetric || A.triangle() != triangle_){
+            throw std::invalid_argument("IC0 requires a compressed symmetric (Hermitian if complex) matrix with the pattern of the factorization");
+        }
+        //the values are kept as elements of L, the upper triangle stores their conjugate
+        const bool conj = triangle_ == Triangle::Upper;
+        std::vector<T> l(A.nonZeros());
+        A.visit_values([&l,conj](const auto& vals){
+            for(std::size_t k=0;k<vals.size();++k){
+                l[k] = conj ? conjugate(static_cast<T>(vals[k])) : static_cast<T>(vals[k]);
+            }
+        });
+        const std::size_t n = A.rows();
+        const std::size_t missing = l.size();
+        std::vector<std::size_t> diagonal(n,missing);
+        //row version: L(i,k) = (A(i,k) - sum_j<k L(i,j) conj(L(k,j))) / L(k,k), the sum is done
+        //merging the sorted rows i and k, so only the pattern is used
+        for(std::size_t i=0;i<n;++i){
+            for(std::size_t e=rows_.ptr[i];e<rows_.ptr[i+1] && rows_.index[e] <= i;++e){
+                const std::size_t k = rows_.index[e];
+                T sum = l[rows_.pos[e]];
+                std::size_t a = rows_.ptr[i], b = rows_.ptr[k];
+                while(a < e && b < rows_.ptr[k+1] && rows_.index[b] < k){
+                    if(rows_.index[a] < rows_.index[b]){
+                        ++a;
+                    }else if(rows_.index[b] < rows_.index[a]){
+                        ++b;
+                    }else{
+                        sum -= l[rows_.pos[a++]]*conjugate(l[rows_.pos[b++]]);
+                    }
+                }
+                if(k < i){
+                    l[rows_.pos[e]] = sum/l[diagonal[k]];
+                }else{
+                    if(std::real(sum) <= 0){
+                        throw std::runtime_error("IC0: the matrix is not positive definite");
+                    }
+                    l[rows_.pos[e]] = std::sqrt(sum);
+                    diagonal[i] = rows_.pos[e];
+                }
+            }
+            if(diagonal[i] == missing){
+                throw std::runtime_error("IC0: zero pivot");
+            }
+        }
+        if(conj){
+            std::transform(l.cbegin(),l.cend(),l.begin(),[](const T& v){return conjugate(v);});
+        }
+        factors.set_values(std::move(l));
+    }
+
+    template<ScalarOrComplex T,StorageOrder Order>
+    template<parallel::VectorOf<T> R,parallel::VectorOf<T> Z>
+    void IC0<T,Order>::apply(const R& r,Z& z)const{
+        triangular_solve(factors,forward,r,work);
+        triangular_solve(factors,backward,work,z);
+    }
+}  // namespace algebra
+
+#endif // SPARSEMATRIXPRECONDITIONER_HPP
@@ -0,0 +1,479 @@
+#ifndef SPARSEMATRIXSOLVERS_HPP
+#define SPARSEMATRIXSOLVERS_HPP
+#include "SparseMatrix.hpp"
+
+namespace algebra {
+
+    //Stopping criteria of the iterative solvers: the iterations stop when
+    //||b - A x|| <= tolerance*||b|| or after maxIterations matrix vector products
+    struct SolverOptions {
+        std::size_t maxIterations = 1000;
+        double tolerance = 1e-10;
+        //size of the Krylov space of GMRES before the restart
+        std::size_t restart = 30;
+        //PipelinedCG replaces the recurrences of the residual with the true residual every
+        //residualReplacement iterations (0 never)
+        std::size_t residualReplacement = 50;
+    };
+
+    struct SolverResult {
+        bool converged;
+        std::size_t iterations;
+        //relative residual ||b - A x||/||b||
+        double residual;
+    };
+
+    //Preconditioner that does nothing, the interface is the one of ILU0 and IC0
+    struct IdentityPreconditioner {
+        template<typename R,typename Z>
+        void apply(const R& r,Z& z)const{parallel::copy(z,r);}
+    };
+
+    //Euclidean norm, in parallel
+    template<typename V>
+    double norm2(const V& a){
+        return std::sqrt(static_cast<double>(std::real(dot(a,a))));
+    }
+
+    //the solvers need a square matrix and a right hand side with its rows
+    template<ScalarOrComplex T,StorageOrder Order,typename B>
+    void check_system(const Matrix<T,Order>& A,const B& b){
+        if(A.rows() != A.cols() || b.size() != A.rows()){
+            throw std::invalid_argument("The solvers need a square matrix and a right hand side of its size");
+        }
+    }
+
+    //r = b - A x, returns ||r||
+    template<ScalarOrComplex T,StorageOrder Order,parallel::VectorOf<T> B = std::vector<T>,parallel::VectorOf<T> X = std::vector<T>,parallel::VectorOf<T> R>
+    double residual(const Matrix<T,Order>& A,const B& b,const X& x,R& r){
+        if(b.size() != A.rows()){
+            throw std::invalid_argument("Error dimension not coeirent");
+        }
+        multiply(A,x,r);
+        return std::sqrt(parallel::reduce(r.size(),0.0,[&](std::size_t begin,std::size_t end){
+            double sum = 0.0;
+            for(std::size_t i=begin;i<end;++i){
+                r[i] = b[i] - r[i];
+                sum += std::norm(r[i]);
+            }
+            return sum;
+        }));
+    }
+
+    //Preconditioned Conjugate Gradient for Hermitian positive definite matrices.
+    //The work vectors are kept between the calls of solve, all the solvers store them as
+    //first_touch_vector written first with the split of the kernels
+    template<ScalarOrComplex T,StorageOrder Order>
+    class ConjugateGradient {
+    private:
+        SolverOptions options;
+        parallel::first_touch_vector<T> r,z,p,q;
+    public:
+        explicit ConjugateGradient(SolverOptions options_ = {}): options(options_){};
+        template<typename Preconditioner = IdentityPreconditioner>
+        SolverResult solve(const Matrix<T,Order>& A,const std::vector<T>& b,std::vector<T>& x,const Preconditioner& M = {});
+    };
+
+    template<ScalarOrComplex T,StorageOrder Order>
+    template<typename Preconditioner>
+    SolverResult ConjugateGradient<T,Order>::solve(const Matrix<T,Order>& A,const std::vector<T>& b,std::vector<T>& x,const Preconditioner& M){
+        check_system(A,b);
+        x.resize(A.cols(),static_cast<T>(0));
+        const double normB = norm2(b);
+        if(normB == 0.0){
+            std::fill(x.begin(),x.end(),static_cast<T>(0));
+            return {true,0,0.0};
+        }
+        double res = residual(A,b,x,r)/normB;
+        M.apply(r,z);
+        parallel::copy(p,z);
+        T rz = dot(r,z);
+        std::size_t k = 0;
+        for(;k<options.maxIterations && res > options.tolerance;++k){
+            //q = A p and (p,q) in the same pass
+            const T alpha = rz/multiply_dot(A,p,q,p);
+            //update of x and r, the norm of r is computed in the same pass
+            const double normR = std::sqrt(parallel::reduce(x.size(),0.0,[&](std::size_t begin,std::size_t end){
+                double sum = 0.0;
+                for(std::size_t i=begin;i<end;++i){
+                    x[i] += alpha*p[i];
+                    r[i] -= alpha*q[i];
+                    sum += std::norm(r[i]);
+                }
+                return sum;
+            }));
+            res = normR/normB;
+            M.apply(r,z);
+            const T rzNew = dot(r,z);
+            const T beta = rzNew/rz;
+            rz = rzNew;
+            parallel::for_each_chunk(p.size(),[&](std::size_t,std::size_t begin,std::size_t end){
+                for(std::size_t i=begin;i<end;++i){
+                    p[i] = z[i] + beta*p[i];
+                }
+            });
+        }
+        return {res <= options.tolerance,k,res};
+    }
+
+    //Pipelined preconditioned Conjugate Gradient (Ghysels, Vanroose): the scalar products of an
+    //iteration, (r,u), (w,u) and ||r||^2, are reduced in a single task on the pool (parallel::async)
+    //while m = M w and n = A m, that do not depend on them, are computed by the calling thread, so
+    //the reduction is hidden behind the preconditioner and the product. It pays off when the
+    //reductions are expensive (many threads, small rows), otherwise the extra vector updates make
+    //it slower than CG. The recurrences of the residual lose accuracy faster than in CG, so every
+    //options.residualReplacement iterations the vectors are computed again from x (3 products and
+    //2 applications of M more). The residual returned by solve is the true one ||b - A x||,
+    //computed again at the end
+    template<ScalarOrComplex T,StorageOrder Order>
+    class PipelinedCG {
+    private:
+        SolverOptions options;
+        parallel::first_touch_vector<T> r,u,w,m,n,zv,q,s,p;
+    public:
+        explicit PipelinedCG(SolverOptions options_ = {}): options(options_){};
+        template<typename Preconditioner = IdentityPreconditioner>
+        SolverResult solve(const Matrix<T,Order>& A,const std::vector<T>& b,std::vector<T>& x,const Preconditioner& M = {});
+    };
+
+    template<ScalarOrComplex T,StorageOrder Order>
+    template<typename Preconditioner>
+    SolverResult PipelinedCG<T,Order>::solve(const Matrix<T,Order>& A,const std::vector<T>& b,std::vector<T>& x,const Preconditioner& M){
+        check_system(A,b);
+        x.resize(A.cols(),static_cast<T>(0));
+        const double normB = norm2(b);
+        if(normB == 0.0){
+            std::fill(x.begin(),x.end(),static_cast<T>(0));
+            return {true,0,0.0};
+        }
+        const std::size_t size = x.size();
+        //gamma = (r,u), delta = (w,u) and ||r||^2, reduced on the pool: only r, u and w are read
+        using Sums = std::array<T,3>;
+        auto reduction = [this,size](){
+            return parallel::async([this,size](){
+                return parallel::reduce(size,Sums{},[this](std::size_t begin,std::size_t end){
+                    Sums partial{};
+                    for(std::size_t i=begin;i<end;++i){
+                        partial[0] += conjugate(r[i])*u[i];
+                        partial[1] += conjugate(w[i])*u[i];
+                        partial[2] += conjugate(r[i])*r[i];
+                    }
+                    return partial;
+                },[](Sums a,const Sums& c){
+                    for(std::size_t j=0;j<a.size();++j){
+                        a[j] += c[j];
+                    }
+                    return a;
+                });
+            });
+        };
+        //r = b - A x, u = M r, w = A u
+        auto restart = [&](){
+            residual(A,b,x,r);
+            M.apply(r,u);
+            multiply(A,u,w);
+        };
+        restart();
+        for(auto* v : {&zv,&q,&s,&p}){
+            parallel::fill(*v,size,static_cast<T>(0));
+        }
+        T gammaOld = static_cast<T>(0), alphaOld = static_cast<T>(0);
+        double res = 0.0;
+        std::size_t k = 0;
+        for(;k<=options.maxIterations;++k){
+            //the scalar products overlap with m = M w and n = A m
+            std::future<Sums> pending = reduction();
+            M.apply(w,m);
+            multiply(A,m,n);
+            const Sums sums = pending.get();
+            res = std::sqrt(std::real(sums[2]))/normB;
+            if(res <= options.tolerance || k == options.maxIterations){
+                break;
+            }
+            const T gamma = sums[0], delta = sums[1];
+            T alpha, beta;
+            if(k == 0){
+                beta = static_cast<T>(0);
+                alpha = gamma/delta;
+            }else{
+                beta = gamma/gammaOld;
+                alpha = gamma/(delta - beta*gamma/alphaOld);
+            }
+            gammaOld = gamma;
+            alphaOld = alpha;
+            parallel::for_each_chunk(size,[&](std::size_t,std::size_t begin,std::size_t end){
+                for(std::size_t i=begin;i<end;++i){
+                    zv[i] = n[i] + beta*zv[i];
+                    q[i] = m[i] + beta*q[i];
+                    s[i] = w[i] + beta*s[i];
+                    p[i] = u[i] + beta*p[i];
+                    x[i] += alpha*p[i];
+                    r[i] -= alpha*s[i];
+                    u[i] -= alpha*q[i];
+                    w[i] -= alpha*zv[i];
+                }
+            });
+            //residual replacement: s = A p, q = M s, zv = A q as in the recurrences
+            if(options.residualReplacement != 0 && (k+1) % options.residualReplacement == 0){
+                restart();
+                multiply(A,p,s);
+                M.apply(s,q);
+                multiply(A,q,zv);
+            }
+        }
+        //the recurrence residual can be far from the true one at the end
+        res = residual(A,b,x,r)/normB;
+        return {res <= options.tolerance,k,res};
+    }
+
+    //Preconditioned (on the right) BiCGStab for general matrices
+    template<ScalarOrComplex T,StorageOrder Order>
+    class BiCGStab {
+    private:
+        SolverOptions options;
+        parallel::first_touch_vector<T> r,rHat,p,pHat,v,sv,sHat,t;
+    public:
+        explicit BiCGStab(SolverOptions options_ = {}): options(options_){};
+        template<typename Preconditioner = IdentityPreconditioner>
+        SolverResult solve(const Matrix<T,Order>& A,const std::vector<T>& b,std::vector<T>& x,const Preconditioner& M = {});
+    };
+
+    template<ScalarOrComplex T,StorageOrder Order>
+    template<typename Preconditioner>
+    SolverResult BiCGStab<T,Order>::solve(const Matrix<T,Order>& A,const std::vector<T>& b,std::vector<T>& x,const Preconditioner& M){
+        check_system(A,b);
+        x.resize(A.cols(),static_cast<T>(0));
+        const double normB = norm2(b);
+        if(normB == 0.0){
+            std::fill(x.begin(),x.end(),static_cast<T>(0));
+            return {true,0,0.0};
+        }
+        const std::size_t size = x.size();
+        double res = residual(A,b,x,r)/normB;
+        parallel::copy(rHat,r);
+        parallel::fill(p,size,static_cast<T>(0));
+        parallel::fill(v,size,static_cast<T>(0));
+        T rho = static_cast<T>(1), alpha = static_cast<T>(1), omega = static_cast<T>(1);
+        std::size_t k = 0;
+        for(;k<options.maxIterations && res > options.tolerance;++k){
+            const T rhoNew = dot(rHat,r);
+            if(rhoNew == static_cast<T>(0)){
+                //breakdown, the method cannot continue
+                break;
+            }
+            const T beta = (rhoNew/rho)*(alpha/omega);
+            rho = rhoNew;
+            parallel::for_each_chunk(size,[&](std::size_t,std::size_t begin,std::size_t end){
+                for(std::size_t i=begin;i<end;++i){
+                    p[i] = r[i] + beta*(p[i] - omega*v[i]);
+                }
+            });
+            M.apply(p,pHat);
+            //v = A pHat and (rHat,v) in one pass
+            alpha = rho/multiply_dot(A,pHat,v,rHat);
+            parallel::resize(sv,size);
+            const double normS = std::sqrt(parallel::reduce(size,0.0,[&](std::size_t begin,std::size_t end){
+                double sum = 0.0;
+                for(std::size_t i=begin;i<end;++i){
+                    sv[i] = r[i] - alpha*v[i];
+                    sum += std::norm(sv[i]);
+                }
+                return sum;
+            }));
+            if(normS/normB <= options.tolerance){
+                parallel::for_each_chunk(size,[&](std::size_t,std::size_t begin,std::size_t end){
+                    for(std::size_t i=begin;i<end;++i){
+                        x[i] += alpha*pHat[i];
+                    }
+                });
+                r.swap(sv);
+                res = normS/normB;
+                ++k;
+                break;
+            }
+            M.apply(sv,sHat);
+            multiply(A,sHat,t);
+            //(t,s) and (t,t) in one reduction
+            using Sums = std::array<T,2>;
+            const Sums sums = parallel::reduce(size,Sums{},[&](std::size_t begin,std::size_t end){
+                Sums partial{};
+                for(std::size_t i=begin;i<end;++i){
+                    partial[0] += conjugate(t[i])*sv[i];
+                    partial[1] += conjugate(t[i])*t[i];
+                }
+                return partial;
+            },[](Sums a,const Sums& c){
+                a[0] += c[0];
+                a[1] += c[1];
+                return a;
+            });
+            omega = sums[0]/sums[1];
+            //update of x and r, with the norm of r in the same pass
+            res = std::sqrt(parallel::reduce(size,0.0,[&](std::size_t begin,std::size_t end){
+                double sum = 0.0;
+                for(std::size_t i=begin;i<end;++i){
+                    x[i] += alpha*pHat[i] + omega*sHat[i];
+                    r[i] = sv[i] - omega*t[i];
+                    sum += std::norm(r[i]);
+                }
+                return sum;
+            }))/normB;
+            if(omega == static_cast<T>(0)){
+                ++k;
+                break;
+            }
+        }
+        return {res <= options.tolerance,k,res};
+    }
+
+    //Restarted GMRES(m), preconditioned on the right so the residual is the true one.
+    //The orthogonalization is the classical Gram-Schmidt repeated twice, so all the
+    //scalar products with the basis are computed in one pass on memory
+    template<ScalarOrComplex T,StorageOrder Order>
+    class GMRES {
+    private:
+        SolverOptions options;
+        //Krylov basis, Hessenberg matrix (by columns), Givens rotations and right hand side
+        std::vector<parallel::first_touch_vector<T>> V;
+        std::vector<std::vector<T>> H;
+        std::vector<double> cs;
+        std::vector<T> sn,g,h;
+        parallel::first_touch_vector<T> r,w,z;
+        //h = V[0:j]^H w and w -= V[0:j] h, fused by chunks
+        void orthogonalize(std::size_t j);
+    public:
+        explicit GMRES(SolverOptions options_ = {}): options(options_){};
+        template<typename Preconditioner = IdentityPreconditioner>
+        SolverResult solve(const Matrix<T,Order>& A,const std::vector<T>& b,std::vector<T>& x,const Preconditioner& M = {});
+    };
+
+    template<ScalarOrComplex T,StorageOrder Order>
+    void GMRES<T,Order>::orthogonalize(std::size_t j){
+        const std::size_t size = w.size();
+        using Sums = std::vector<T>;
+        std::fill(h.begin(),h.begin()+j+2,static_cast<T>(0));
+        for(int pass=0;pass<2;++pass){
+            const Sums c = parallel::reduce(size,Sums(j+1,static_cast<T>(0)),[&](std::size_t begin,std::size_t end){
+                Sums partial(j+1,static_cast<T>(0));
+                for(std::size_t l=0;l<=j;++l){
+                    T sum = static_cast<T>(0);
+                    for(std::size_t i=begin;i<end;++i){
+                        sum += conjugate(V[l][i])*w[i];
+                    }
+                    partial[l] = sum;
+                }
+                return partial;
+            },[](Sums a,const Sums& c){
+                for(std::size_t l=0;l<a.size();++l){
+                    a[l] += c[l];
+                }
+                return a;
+            });
+            parallel::for_each_chunk(size,[&](std::size_t,std::size_t begin,std::size_t end){
+                for(std::size_t l=0;l<=j;++l){
+                    for(std::size_t i=begin;i<end;++i){
+                        w[i] -= c[l]*V[l][i];
+                    }
+                }
+            });
+            for(std::size_t l=0;l<=j;++l){
+                h[l] += c[l];
+            }
+        }
+    }
+
+    template<ScalarOrComplex T,StorageOrder Order>
+    template<typename Preconditioner>
+    SolverResult GMRES<T,Order>::solve(const Matrix<T,Order>& A,const std::vector<T>& b,std::vector<T>& x,const Preconditioner& M){
+        check_system(A,b);
+        x.resize(A.cols(),static_cast<T>(0));
+        const double normB = norm2(b);
+        if(normB == 0.0){
+            std::fill(x.begin(),x.end(),static_cast<T>(0));
+            return {true,0,0.0};
+        }
+        const std::size_t size = x.size();
+        const std::size_t m = std::max<std::size_t>(1,options.restart);
+        V.resize(m+1);
+        H.assign(m,std::vector<T>(m+1,static_cast<T>(0)));
+        cs.assign(m,0.0);
+        sn.assign(m,static_cast<T>(0));
+        g.assign(m+1,static_cast<T>(0));
+        h.assign(m+1,static_cast<T>(0));
+        double beta = residual(A,b,x,r);
+        double res = beta/normB;
+        std::size_t k = 0;
+        while(k < options.maxIterations && res > options.tolerance){
+            parallel::resize(V[0],size);
+            parallel::for_each_chunk(size,[&](std::size_t,std::size_t begin,std::size_t end){
+                for(std::size_t i=begin;i<end;++i){
+                    V[0][i] = r[i]/static_cast<T>(beta);
+                }
+            });
+            std::fill(g.begin(),g.end(),static_cast<T>(0));
+            g[0] = static_cast<T>(beta);
+            std::size_t j = 0;
+            for(;j<m && k<options.maxIterations && res > options.tolerance;++j,++k){
+                M.apply(V[j],z);
+                multiply(A,z,w);
+                orthogonalize(j);
+                h[j+1] = static_cast<T>(norm2(w));
+                parallel::resize(V[j+1],size);
+                parallel::for_each_chunk(size,[&](std::size_t,std::size_t begin,std::size_t end){
+                    for(std::size_t i=begin;i<end;++i){
+                        V[j+1][i] = std::abs(h[j+1]) > 0 ? w[i]/h[j+1] : static_cast<T>(0);
+                    }
+                });
+                //apply the previous rotations to the new column and compute a new one
+                for(std::size_t l=0;l<j;++l){
+                    const T tmp = cs[l]*h[l] + sn[l]*h[l+1];
+                    h[l+1] = -conjugate(sn[l])*h[l] + cs[l]*h[l+1];
+                    h[l] = tmp;
+                }
+                const double absA = std::abs(h[j]), absB = std::abs(h[j+1]);
+                const double rho = std::hypot(absA,absB);
+                if(absA == 0.0){
+                    cs[j] = 0.0;
+                    sn[j] = static_cast<T>(1);
+                }else{
+                    cs[j] = absA/rho;
+                    sn[j] = (h[j]/static_cast<T>(absA))*conjugate(h[j+1])/static_cast<T>(rho);
+                }
+                h[j] = cs[j]*h[j] + sn[j]*h[j+1];
+                h[j+1] = static_cast<T>(0);
+                g[j+1] = -conjugate(sn[j])*g[j];
+                g[j] = cs[j]*g[j];
+                std::copy(h.cbegin(),h.cbegin()+j+1,H[j].begin());
+                res = std::abs(g[j+1])/normB;
+            }
+            //y = H^-1 g by back substitution, then x += M^-1 (V y)
+            std::vector<T> y(g.cbegin(),g.cbegin()+j);
+            for(std::size_t l=j;l-- > 0;){
+                for(std::size_t c=l+1;c<j;++c){
+                    y[l] -= H[c][l]*y[c];
+                }
+                y[l] /= H[l][l];
+            }
+            parallel::fill(w,size,static_cast<T>(0));
+            parallel::for_each_chunk(size,[&](std::size_t,std::size_t begin,std::size_t end){
+                for(std::size_t l=0;l<j;++l){
+                    for(std::size_t i=begin;i<end;++i){
+                        w[i] += y[l]*V[l][i];
+                    }
+                }
+            });
+            M.apply(w,z);
+            parallel::for_each_chunk(size,[&](std::size_t,std::size_t begin,std::size_t end){
+                for(std::size_t i=begin;i<end;++i){
+                    x[i] += z[i];
+                }
+            });
+            //true residual at the restart
+            beta = residual(A,b,x,r);
+            res = beta/normB;
+        }
+        return {res <= options.tolerance,k,res};
+    }
+}  // namespace algebra
+
+#endif // SPARSEMATRIXSOLVERS_HPP
@@ -0,0 +1,284 @@
+#ifndef SPARSEMATRIXSTREAMING_HPP
+#define SPARSEMATRIXSTREAMING_HPP
+#include "SparseMatrix.hpp"
+#include <future>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+
+namespace algebra {
+
+    //Element of a matrix read from a file
+    template<ScalarOrComplex T>
+    struct Triplet {
+        std::size_t row;
+        std::size_t col;
+        T value;
+    };
+
+    //Kind of the values of a binary file, with the size it identifies the type
+    enum class ValueKind : std::uint32_t { SignedInteger, UnsignedInteger, Floating, Complex };
+    template<ScalarOrComplex T>
+    constexpr ValueKind value_kind(){
+        if constexpr(Complex<T>){
+            return ValueKind::Complex;
+        }else if constexpr(std::is_floating_point_v<T>){
+            return ValueKind::Floating;
+        }else if constexpr(std::is_signed_v<T>){
+            return ValueKind::SignedInteger;
+        }else{
+            return ValueKind::UnsignedInteger;
+        }
+    }
+
+    //Header of the binary files written by write_binary: magic string, sizes, symmetry,
+    //size and kind of a value. Then the elements follow sorted by row as (row,col,value), 0-based
+    struct BinaryHeader {
+        char magic[8];
+        std::uint64_t numRows;
+        std::uint64_t numCols;
+        std::uint64_t numNonZero;
+        std::uint32_t symmetry;
+        std::uint32_t valueSize;
+        std::uint32_t valueKind;
+        std::uint32_t reserved;
+    };
+    //the version 2 has the kind of the values
+    inline constexpr char binaryMagic[8] = {'A','L','G','S','P','M','V','2'};
+
+    //Writes a compressed matrix in the binary format read by StreamingMatrix, sorted by row
+    template<ScalarOrComplex T,StorageOrder Order>
+    void write_binary(const Matrix<T,Order>& matrix,const std::string& file_name){
+        if(!matrix.is_compressed()){
+            throw std::invalid_argument("The matrix must be compressed");
+        }
+        std::ofstream file(file_name,std::ios::binary);
+        if(!file.is_open()){
+            throw std::runtime_error("Impossible open file: " + file_name);
+        }
+        BinaryHeader header{};
+        std::memcpy(header.magic,binaryMagic,sizeof(header.magic));
+        header.numRows = matrix.rows();
+        header.numCols = matrix.cols();
+        header.numNonZero = matrix.nonZeros();
+        header.symmetry = static_cast<std::uint32_t>(matrix.symmetry());
+        header.valueSize = sizeof(T);
+        header.valueKind = static_cast<std::uint32_t>(value_kind<T>());
+        file.write(reinterpret_cast<const char*>(&header),sizeof(header));
+        //for ColumnMajor the elements are visited by row with the transposed index
+        matrix.visit_values([&](const auto& vals){
+            visit_entry_lists(*matrix.pattern(),true,[&](const auto& ptr,const auto& index,auto position){
+                for(std::size_t i=0;i<matrix.rows();++i){
+                    for(std::size_t e=ptr[i];e<ptr[i+1];++e){
+                        const std::uint64_t record[2] = {i,index[e]};
+                        const T value = static_cast<T>(vals[position(e)]);
+                        file.write(reinterpret_cast<const char*>(record),sizeof(record));
+                        file.write(reinterpret_cast<const char*>(&value),sizeof(value));
+                    }
+                }
+            });
+        });
+    }
+
+    //Matrix that stays on disk: each product reads the file once in chunks of a bounded number
+    //of elements. The next chunk is read (and parsed) by another thread while the current one is
+    //multiplied, so the reading is overlapped with the computation. Only two chunks and the
+    //vectors are in memory. The file is a Matrix Market file or a binary file of write_binary,
+    //in both cases with the elements sorted by row
+    template<ScalarOrComplex T>
+    class StreamingMatrix {
+    private:
+        std::string fileName;
+        bool binary;
+        std::size_t chunkSize;
+        std::size_t numRows;
+        std::size_t numCols;
+        std::size_t numNonZero;
+        Symmetry symmetryType;
+        //field of the Matrix Market file (real, complex, integer or pattern)
+        std::string field;
+        //position of the first element in the file
+        std::streampos dataOffset;
+        //reads at most chunkSize of the remaining elements, lastRow is used to check the order of the rows.
+        //buffer holds the records of a binary file, it is reused by the next chunks.
+        //Throws if the file ends before the elements of its header
+        void read_chunk(std::istream& file,std::vector<Triplet<T>>& chunk,std::vector<char>& buffer,std::size_t& lastRow,std::size_t& remaining)const;
+        //y += A x for the elements of the chunk
+        void multiply_chunk(const std::vector<Triplet<T>>& chunk,const std::vector<T>& x,std::vector<T>& y)const;
+    public:
+        explicit StreamingMatrix(const std::string& file_name,std::size_t chunkSize_ = std::size_t(1)<<20);
+        std::size_t rows()const{return numRows;};
+        std::size_t cols()const{return numCols;};
+        std::size_t nonZeros()const{return numNonZero;};
+        Symmetry symmetry()const{return symmetryType;};
+        //y = A x, reading the matrix from the file
+        void multiply(const std::vector<T>& x,std::vector<T>& y)const;
+    };
+
+    template<ScalarOrComplex T>
+    StreamingMatrix<T>::StreamingMatrix(const std::string& file_name,std::size_t chunkSize_):
+        fileName(file_name),binary(false),chunkSize(std::max<std::size_t>(1,chunkSize_)){
+        std::ifstream file(fileName,std::ios::binary);
+        if(!file.is_open()){
+            throw std::runtime_error("Impossible open file: " + fileName);
+        }
+        BinaryHeader header{};
+        file.read(reinterpret_cast<char*>(&header),sizeof(header));
+        if(file && std::memcmp(header.magic,binaryMagic,sizeof(header.magic)) == 0){
+            if(header.valueSize != sizeof(T) || header.valueKind != static_cast<std::uint32_t>(value_kind<T>())){
+                throw std::runtime_error("The values in the file are not of the type of the matrix");
+            }
+            binary = true;
+            numRows = header.numRows;
+            numCols = header.numCols;
+            numNonZero = header.numNonZero;
+            symmetryType = static_cast<Symmetry>(header.symmetry);
+            dataOffset = file.tellg();
+            return;
+        }
+        file.clear();
+        file.seekg(0);
+        const MatrixMarketHeader mtx = read_header(file);
+        numRows = mtx.numRows;
+        numCols = mtx.numCols;
+        numNonZero = mtx.numNonZero;
+        symmetryType = mtx.symmetry;
+        field = mtx.field;
+        dataOffset = file.tellg();
+    }
+
+    template<ScalarOrComplex T>
+    void StreamingMatrix<T>::read_chunk(std::istream& file,std::vector<Triplet<T>>& chunk,std::vector<char>& buffer,std::size_t& lastRow,std::size_t& remaining)const{
+        chunk.clear();
+        const std::size_t wanted = std::min(chunkSize,remaining);
+        if(binary){
+            //a record is (row,col,value) without padding
+            constexpr std::size_t recordSize = 2*sizeof(std::uint64_t) + sizeof(T);
+            buffer.resize(wanted*recordSize);
+            file.read(buffer.data(),static_cast<std::streamsize>(buffer.size()));
+            if(static_cast<std::size_t>(file.gcount()) != buffer.size()){
+                throw std::runtime_error("The file has less elements than its header: " + fileName);
+            }
+            const std::size_t count = wanted;
+            chunk.resize(count);
+            for(std::size_t e=0;e<count;++e){
+                std::uint64_t index[2];
+                std::memcpy(index,buffer.data()+e*recordSize,sizeof(index));
+                std::memcpy(&chunk[e].value,buffer.data()+e*recordSize+sizeof(index),sizeof(T));
+                chunk[e].row = index[0];
+                chunk[e].col = index[1];
+            }
+        }else{
+            std::string line;
+            while(chunk.size() < wanted && std::getline(file,line)){
+                //the fields of the line: row, column and the parts of the value
+                std::array<std::string_view,4> fields;
+                std::size_t count = 0;
+                for(std::size_t p=0;p<line.size() && count<fields.size();){
+                    while(p<line.size() && std::isspace(static_cast<unsigned char>(line[p]))){
+                        ++p;
+                    }
+                    const std::size_t start = p;
+                    while(p<line.size() && !std::isspace(static_cast<unsigned char>(line[p]))){
+                        ++p;
+                    }
+                    if(p > start){
+                        fields[count++] = std::string_view(line).substr(start,p-start);
+                    }
+                }
+                if(count == 0){
+                    continue;
+                }
+                std::size_t row = 0,col = 0;
+                if(count < 2 ||
+                   std::from_chars(fields[0].data(),fields[0].data()+fields[0].size(),row).ec != std::errc() ||
+                   std::from_chars(fields[1].data(),fields[1].data()+fields[1].size(),col).ec != std::errc() ||
+                   row == 0 || col == 0){
+                    throw std::runtime_error("Invalid element in the file: " + line);
+                }
+                chunk.push_back({row-1,col-1,element_value<T>(field,fields[2],fields[3])});
+            }
+            if(chunk.size() < wanted){
+                throw std::runtime_error("The file has less elements than its header: " + fileName);
+            }
+        }
+        remaining -= chunk.size();
+        for(const auto& entry : chunk){
+            if(entry.row < lastRow){
+                throw std::runtime_error("The elements of the file are not sorted by row");
+            }
+            if(entry.row >= numRows || entry.col >= numCols){
+                throw std::out_of_range("Index out of boundary");
+            }
+            lastRow = entry.row;
+        }
+    }
+
+    template<ScalarOrComplex T>
+    void StreamingMatrix<T>::multiply_chunk(const std::vector<Triplet<T>>& chunk,const std::vector<T>& x,std::vector<T>& y)const{
+        if(symmetryType != Symmetry::General){
+            //the symmetric contributions scatter on all the result, so the chunk is done by one thread
+            for(const auto& [row,col,value] : chunk){
+                y[row] += value*x[col];
+                if(row != col){
+                    y[col] += (symmetryType == Symmetry::Hermitian ? conjugate(value) : value)*x[row];
+                }
+            }
+            return;
+        }
+        //the blocks of the threads are moved to the start of a row, so a row is done by one thread
+        auto rowStart = [&chunk](std::size_t p){
+            while(p > 0 && p < chunk.size() && chunk[p].row == chunk[p-1].row){
+                ++p;
+            }
+            return p;
+        };
+        parallel::for_each_chunk(chunk.size(),[&](std::size_t,std::size_t begin,std::size_t end){
+            for(std::size_t e=rowStart(begin);e<rowStart(end);++e){
+                y[chunk[e].row] += chunk[e].value*x[chunk[e].col];
+            }
+        });
+    }
+
+    template<ScalarOrComplex T>
+    void StreamingMatrix<T>::multiply(const std::vector<T>& x,std::vector<T>& y)const{
+        if(x.size() != numCols){
+            throw std::invalid_argument("Error dimension not coeirent");
+        }
+        std::ifstream file(fileName,binary ? std::ios::binary : std::ios::in);
+        if(!file.is_open()){
+            throw std::runtime_error("Impossible open file: " + fileName);
+        }
+        file.seekg(dataOffset);
+        y.assign(numRows,static_cast<T>(0));
+        //double buffering: the reader fills a buffer while the other one is multiplied,
+        //each buffer has its own storage of the records, allocated once
+        std::array<std::vector<Triplet<T>>,2> buffers;
+        std::array<std::vector<char>,2> records;
+        std::size_t lastRow = 0;
+        std::size_t remaining = numNonZero;
+        auto read = [this,&file,&lastRow,&remaining,&buffers,&records](std::size_t slot){
+            read_chunk(file,buffers[slot],records[slot],lastRow,remaining);
+        };
+        //the reader is a task of the pool: while it reads, its chunks of the product are run by
+        //the other threads. With a single thread the chunk is read before it is multiplied
+        std::future<void> pending = parallel::async([&read](){read(0);});
+        for(std::size_t current=0;;current ^= 1){
+            pending.get();
+            if(buffers[current].empty()){
+                break;
+            }
+            const std::size_t next = current ^ 1;
+            pending = parallel::async([&read,next](){read(next);});
+            try{
+                multiply_chunk(buffers[current],x,y);
+            }catch(...){
+                //the reader uses the buffers and the file of this call
+                pending.wait();
+                throw;
+            }
+        }
+    }
+}  // namespace algebra
+
+#endif // SPARSEMATRIXSTREAMING_HPP
@@ -19,5 +19,48 @@ concept Complex = requires(T t) {
 //a complex value
 template<typename T>
 concept ScalarOrComplex = Numeric<T> || Complex<T>;
+
+//Type used to store the values of a matrix compressed with reduced precision,
+//the arithmetic is still done with the type T of the matrix
+template<typename T>
+struct ReducedPrecision{ using type = T; };
+template<>
+struct ReducedPrecision<double>{ using type = float; };
+template<>
+struct ReducedPrecision<long double>{ using type = double; };
+template<typename T>
+struct ReducedPrecision<std::complex<T>>{ using type = std::complex<typename ReducedPrecision<T>::type>; };
+
+template<typename T>
+using ReducedPrecision_t = typename ReducedPrecision<T>::type;
+
+//Type of the real and imaginary parts: R for std::complex<R>, T itself for real values
+template<typename T>
+struct RealType{ using type = T; };
+template<typename T>
+struct RealType<std::complex<T>>{ using type = T; };
+
+template<typename T>
+using RealType_t = typename RealType<T>::type;
+
+//squared modulus |value|^2, without the square root of std::abs
+template<ScalarOrComplex T>
+RealType_t<T> abs2(const T& value){
+    if constexpr(Complex<T>){
+        return std::norm(value);
+    }else{
+        return value*value;
+    }
+}
+
+//complex conjugate, the identity for real values
+template<ScalarOrComplex T>
+T conjugate(const T& value){
+    if constexpr(Complex<T>){
+        return std::conj(value);
+    }else{
+        return value;
+    }
+}
 }
 #endif /* SparseMatrixTraits_HPP */
\ No newline at end of file
@@ -3,36 +3,165 @@
 namespace algebra {
     
     template<ScalarOrComplex T>
-    Matrix<T,StorageOrder::RowMajor>:: Matrix(std::size_t nrow,std::size_t ncol): numRows(nrow),numCols(ncol),isCompressed(false){}
+    Matrix<T,StorageOrder::RowMajor>:: Matrix(std::size_t nrow,std::size_t ncol): precision(StoragePrecision::Full),numRows(nrow),numCols(ncol),isCompressed(false),symmetryType(Symmetry::General),storedTriangle(Triangle::Lower){}
+
+    template<ScalarOrComplex T>
+    Matrix<T,StorageOrder::RowMajor>:: Matrix(PatternPtr<StorageOrder::RowMajor> pattern,StoragePrecision precision_,Symmetry symmetry_,Triangle triangle_,ValuesLater): pattern_(std::move(pattern)),precision(precision_),isCompressed(true),symmetryType(symmetry_),storedTriangle(triangle_){
+        if(!pattern_){
+            throw std::invalid_argument("The pattern is empty");
+        }
+        if(precision == StoragePrecision::Split && !Complex<T>){
+            throw std::invalid_argument("The split storage is only for complex matrices");
+        }
+        numRows = pattern_->numRows;
+        numCols = pattern_->numCols;
+    }
+
+    template<ScalarOrComplex T>
+    Matrix<T,StorageOrder::RowMajor>:: Matrix(PatternPtr<StorageOrder::RowMajor> pattern,StoragePrecision precision_,Symmetry symmetry_,Triangle triangle_): Matrix(std::move(pattern),precision_,symmetry_,triangle_,ValuesLater{}){
+        if(symmetryType != Symmetry::General && !pattern_->in_triangle(storedTriangle)){
+            throw std::invalid_argument("The pattern of a symmetric matrix must store only its triangle");
+        }
+        //only the values are allocated, the index structure is the shared one
+        assign_values([](std::size_t){return static_cast<T>(0);});
+        //no autotuning here: the values are not set yet
+        spmvKernel = tuning::select_kernel(pattern_->structure,precision,!pattern_->runStart.empty());
+    }
+
+    template<ScalarOrComplex T>
+    void Matrix<T,StorageOrder::RowMajor>::select_kernel(){
+        spmvKernel = tuning::select_kernel(pattern_->structure,precision,!pattern_->runStart.empty());
+        //the trial is done once for each pattern (and number of threads), then the cache is used
+        if(tuning::autotuning() && !tuning::cached(pattern_->structure.fingerprint,precision)){
+            autotune(*this);
+        }
+    }
+
+    template<ScalarOrComplex T>
+    void Matrix<T,StorageOrder::RowMajor>::set_kernel(SpMVKernel kernel_){
+        if(!isCompressed){
+            throw std::logic_error("The kernel can be set only on a compressed matrix");
+        }
+        if(kernel_ == SpMVKernel::Blocked && pattern_->runStart.empty()){
+            throw std::invalid_argument("The pattern has no runs for the blocked kernel");
+        }
+        spmvKernel = kernel_;
+    }
+
+    template<ScalarOrComplex T>
+    void Matrix<T,StorageOrder::RowMajor>::set_values(std::vector<T> newValues){
+        if(!isCompressed || newValues.size() != pattern_->nonZeros()){
+            throw std::invalid_argument("The values are not coherent with the pattern");
+        }
+        //copied by the threads that use the values in the kernels
+        assign_values([&newValues](std::size_t k){return newValues[k];});
+    }
     
+    template<ScalarOrComplex T>
+    Matrix<T,StorageOrder::RowMajor>& Matrix<T,StorageOrder::RowMajor>::operator*=(const T& alpha){
+        if(symmetryType == Symmetry::Hermitian && std::imag(alpha) != 0){
+            throw std::invalid_argument("A Hermitian matrix can be scaled only by a real number");
+        }
+        if(!isCompressed){
+            for(auto& [key,value] : elements){
+                value *= alpha;
+            }
+        }else if(precision == StoragePrecision::Full){
+            parallel::for_each_position(pattern_->outerIndex,pattern_->byElements,[&](std::size_t k){values[k] *= alpha;});
+        }else if(precision == StoragePrecision::Reduced){
+            parallel::for_each_position(pattern_->outerIndex,pattern_->byElements,[&](std::size_t k){
+                reducedValues[k] = static_cast<ReducedPrecision_t<T>>(static_cast<T>(reducedValues[k])*alpha);
+            });
+        }else if constexpr(Complex<T>){
+            parallel::for_each_position(pattern_->outerIndex,pattern_->byElements,[&](std::size_t k){
+                const T value = T(realValues[k],imagValues[k])*alpha;
+                realValues[k] = value.real();
+                imagValues[k] = value.imag();
+            });
+        }
+        return *this;
+    }
+
+    template<ScalarOrComplex T>
+    SparseVectorView<T> Matrix<T,StorageOrder::RowMajor>::row(std::size_t i)const{
+        if(!isCompressed || precision != StoragePrecision::Full){
+            throw std::logic_error("The row view needs a compressed matrix with full precision");
+        }
+        if(i >= numRows){
+            throw std::out_of_range("Index out of boundary");
+        }
+        const std::size_t first = pattern_->outerIndex[i];
+        const std::size_t count = pattern_->outerIndex[i+1] - first;
+        return {std::span(pattern_->innerIndex).subspan(first,count),std::span(values).subspan(first,count)};
+    }
+
     template<ScalarOrComplex T>
     void Matrix<T,StorageOrder::RowMajor>::resize(std::size_t nr,std::size_t nc){
         numRows=nr;
         numCols=nc;
         isCompressed = false;
     }
+    template<ScalarOrComplex T>
+    std::optional<T> Matrix<T,StorageOrder::RowMajor>::find(std::size_t row,std::size_t col)const{
+        //the elements outside the stored triangle are read from the symmetric one
+        const bool mirrored = symmetryType != Symmetry::General && !in_stored_triangle(row,col);
+        if(mirrored){
+            std::swap(row,col);
+        }
+        std::optional<T> value;
+        if(isCompressed){
+            auto k = pattern_->locate(row,col);
+            if(k != pattern_->nonZeros()){
+                value = visit_values([k](const auto& vals){return static_cast<T>(vals[k]);});
+            }
+        }else{
+            auto it = elements.find({row,col});
+            if(it != elements.end()){
+                value = it->second;
+            }
+        }
+        if(value && mirrored && symmetryType == Symmetry::Hermitian){
+            value = conjugate(*value);
+        }
+        return value;
+    }
+
+    template<ScalarOrComplex T>
+    void Matrix<T,StorageOrder::RowMajor>::set_symmetry(Symmetry symmetry_,Triangle triangle_){
+        if(isCompressed){
+            throw std::logic_error("The symmetry can be changed only on a not compressed matrix");
+        }
+        symmetryType = symmetry_;
+        storedTriangle = triangle_;
+        if(symmetryType == Symmetry::General){
+            return;
+        }
+        //move the elements of the other triangle, the ones already stored have the precedence
+        for(auto it = elements.begin();it != elements.end();){
+            const auto [row,col] = it->first;
+            if(in_stored_triangle(row,col)){
+                ++it;
+                continue;
+            }
+            T value = symmetryType == Symmetry::Hermitian ? conjugate(it->second) : it->second;
+            elements.try_emplace({col,row},value);
+            it = elements.erase(it);
+        }
+    }
+
     // Const operator() to access elements in a compressed or uncompressed matrix
     template <ScalarOrComplex T>
     T Matrix<T,StorageOrder::RowMajor>::operator()(std::size_t row, std::size_t col) const {
         if (row < numRows && col < numCols) {
+                //find takes care of the compressed/uncompressed format and of the symmetry
+                auto value = find(row,col);
+                if(value){
+                    return *value;
+                }
                 if (isCompressed) {
-                    // Access element in compressed matrix
-                        auto it = std::find_if(compressedMatrix[row].cbegin(), compressedMatrix[row].cend(),
-                            [col](const std::pair<std::size_t, T>& p) {
-                                return p.first == col;
-                            });
-                        if(it!= compressedMatrix[row].cend()){
-                            return it->second;
-                        }
                     throw std::out_of_range("Element not exist");
                 } else {
-                    // Access element in uncompressed map
-                    auto it = elements.find({row, col});
-                    if (it != elements.end()) {
-                        return it->second;
-                    } else {
-                        return T(); // Element not found, return default value (0 for numeric types)
-                    }
+                    return T(); // Element not found, return default value (0 for numeric types)
                 }
             } else {
                 throw std::out_of_range("Index out of boundary");
@@ -41,14 +170,22 @@ namespace algebra {
      // Non-const operator() to modify elements in a compressed or uncompressed matrix
     template <ScalarOrComplex T>
     T& Matrix<T,StorageOrder::RowMajor>::operator()(std::size_t row, std::size_t col) {
+        //for symmetric matrices only the stored triangle exists
+        if(symmetryType != Symmetry::General && !in_stored_triangle(row,col)){
+            if(symmetryType == Symmetry::Hermitian){
+                throw std::logic_error("Only the stored triangle of an Hermitian matrix can be modified");
+            }
+            std::swap(row,col);
+        }
         if (isCompressed) {
-        // Check if the element exists and is non-zero in the compressed matrix
-             auto it = std::find_if(compressedMatrix[row].begin(), compressedMatrix[row].end(),
-                            [col](const std::pair<std::size_t, T>& p) {
-                                return p.first == col;
-                            });
-            if (row < numRows && col < numCols && it!=compressedMatrix[row].cend()&&it->second != 0) {
-                return it->second;
+        // Check if the element is stored in the compressed matrix (also an explicit zero of the pattern)
+            if(precision != StoragePrecision::Full){
+                //a reference to T cannot be bound to a value stored with reduced precision or split
+                throw std::logic_error("Cannot modify a matrix stored with reduced precision or split");
+            }
+            std::size_t k = (row < numRows && col < numCols) ? pattern_->locate(row,col) : pattern_->nonZeros();
+            if (k != pattern_->nonZeros()) {
+                return values[k];
             } else {
                 //If the element is not foud this will cause an exception
                 throw std::out_of_range("Index out of boundary");
@@ -61,21 +198,86 @@ namespace algebra {
     // Function to compress the sparse matrix representation (const-correct version)
     template <ScalarOrComplex T>
     void Matrix<T,StorageOrder::RowMajor>::compress()  { 
+        //a compressed matrix keeps its precision
+        compress(isCompressed ? precision : StoragePrecision::Full);
+    }
+
+    template <ScalarOrComplex T>
+    void Matrix<T,StorageOrder::RowMajor>::compress(StoragePrecision precision_)  { 
+        if(precision_ == StoragePrecision::Split && !Complex<T>){
+            throw std::invalid_argument("The split storage is only for complex matrices");
+        }
+        //already compressed: the values are stored again with the new precision on the same pattern
+        if(isCompressed && precision_ != precision){
+            const StoragePrecision old = precision;
+            visit_values([&](const auto& vals){
+                precision = precision_;
+                assign_values([&vals](std::size_t k){return static_cast<T>(vals[k]);});
+            });
+            //the arrays of the old precision are freed
+            if(old == StoragePrecision::Full){
+                parallel::first_touch_vector<T>().swap(values);
+            }else if(old == StoragePrecision::Reduced){
+                parallel::first_touch_vector<ReducedPrecision_t<T>>().swap(reducedValues);
+            }else{
+                parallel::first_touch_vector<RealType_t<T>>().swap(realValues);
+                parallel::first_touch_vector<RealType_t<T>>().swap(imagValues);
+            }
+            //the kernel of a pattern is cached by precision
+            select_kernel();
+        }
         //The change of form must be done only if the Matrix is not already compress
         if(!isCompressed){
-        compressedMatrix.resize(numRows);
-        for(std::size_t i=0;i<numRows;++i){
-            auto cit = elements.lower_bound({i,0});
-            auto cend = elements.lower_bound({i+1,0});
-            for (; cit != cend; ++cit){
-                compressedMatrix[i].emplace_back(cit->first[1],cit->second);
+        precision = precision_;
+        auto pattern = std::make_shared<SparsityPattern<StorageOrder::RowMajor>>();
+        pattern->numRows = numRows;
+        pattern->numCols = numCols;
+        //the map is ordered by row, so every thread finds the first element of its rows with
+        //lower_bound and then counts and copies them: the compressed arrays are touched first by
+        //the same threads (with the same split) that use them in the kernels
+        auto first = [this](std::size_t begin){return elements.lower_bound({begin,0});};
+        pattern->outerIndex.resize(numRows+1);
+        pattern->outerIndex[0] = 0;
+        parallel::for_each_chunk(numRows,[&](std::size_t,std::size_t begin,std::size_t end){
+            std::fill(pattern->outerIndex.begin()+begin+1,pattern->outerIndex.begin()+end+1,0);
+            for(auto it=first(begin);it != elements.end() && it->first[0] < end;++it){
+                ++pattern->outerIndex[it->first[0]+1];
             }
+        });
+        std::partial_sum(pattern->outerIndex.cbegin(),pattern->outerIndex.cend(),pattern->outerIndex.begin());
+        pattern->balance();
+        pattern->innerIndex.resize(elements.size());
+        auto copy = [&](auto&& store){
+            pattern->for_each_outer([&](std::size_t,std::size_t begin,std::size_t end){
+                auto it = first(begin);
+                for(std::size_t k=pattern->outerIndex[begin];k<pattern->outerIndex[end];++k,++it){
+                    pattern->innerIndex[k] = it->first[1];
+                    store(k,it->second);
+                }
+            });
+        };
+        if(precision == StoragePrecision::Full){
+            values.resize(elements.size());
+            copy([this](std::size_t k,const T& value){values[k] = value;});
+        }else if(precision == StoragePrecision::Reduced){
+            reducedValues.resize(elements.size());
+            copy([this](std::size_t k,const T& value){reducedValues[k] = static_cast<ReducedPrecision_t<T>>(value);});
+        }else{
+            realValues.resize(elements.size());
+            imagValues.resize(elements.size());
+            copy([this](std::size_t k,const T& value){
+                realValues[k] = std::real(value);
+                imagValues[k] = std::imag(value);
+            });
         }
+        pattern->analyze(symmetryType);
+        pattern_ = std::move(pattern);
        //Clear the map to free the memory
        elements.clear();
 
         //Set the compressed flag
         isCompressed = true;
+        select_kernel();
     }
     }
 
@@ -88,35 +290,61 @@ namespace algebra {
             }
 
             // Rebuild the elements map from compressed matrix
-            for(std::size_t i=0;i<numRows;++i){
-                for(auto it = compressedMatrix[i].begin();it!=compressedMatrix[i].end();++it){
-                    auto jj = it->first;
-                    elements[{i,jj}] = it->second;
+            visit_values([this](const auto& vals){
+                for(std::size_t i=0;i<numRows;++i){
+                    for(std::size_t k=pattern_->outerIndex[i];k<pattern_->outerIndex[i+1];++k){
+                        elements.emplace_hint(elements.end(),std::array<std::size_t,2>{i,pattern_->innerIndex[k]},static_cast<T>(vals[k]));
+                    }
                 }
-            }
+            });
 
             // Clear the compressed matrix to free memory
-            compressedMatrix.clear();
+            //the pattern is only released, other matrices may still use it
+            pattern_.reset();
+            values.clear();
+            reducedValues.clear();
+            realValues.clear();
+            imagValues.clear();
+            precision = StoragePrecision::Full;
 
             // Reset the compression flag
             isCompressed = false;
     }
     // Function to print the matrix (supports both compressed and uncompressed)
+    template<ScalarOrComplex T>
+    void Matrix<T,StorageOrder::RowMajor>::print_triplets(std::ostream& os)const{
+        os<<numRows<<" "<<numCols<<" "<<nonZeros()<<"\n";
+        for_each_stored([&os](std::size_t row,std::size_t col,const T& value){
+            os<<row<<" "<<col<<" "<<value<<"\n";
+        });
+    }
+
     template <ScalarOrComplex T>
     void Matrix<T,StorageOrder::RowMajor>::print() const {
+        if(symmetryType != Symmetry::General){
+            //the elements of the other triangle are not stored, find gives them by symmetry
+            for(std::size_t i=0;i<numRows;++i){
+                for(std::size_t j=0;j<numCols;++j){
+                    std::cout<<find(i,j).value_or(static_cast<T>(0));
+                }
+                std::cout<<std::endl;
+            }
+            return;
+        }
         if(isCompressed){
+            visit_values([this](const auto& vals){
             for(std::size_t i=0;i<numRows;++i){
+                //the columns of the row are sorted, so we walk them together with j
+                std::size_t k = pattern_->outerIndex[i];
                 for(std::size_t j=0;j<numCols;++j){
-                    auto it = std::find_if(compressedMatrix[i].cbegin(), compressedMatrix[i].cend(),
-                            [j](const std::pair<std::size_t, T>& p) {
-                                return p.first == j;
-                            });
-                    if(it!=compressedMatrix[i].cend()){
-                        std::cout<<it->second;
+                    if(k<pattern_->outerIndex[i+1] && pattern_->innerIndex[k]==j){
+                        std::cout<<static_cast<T>(vals[k]);
+                        ++k;
                     }else{std::cout<<0;}
                 }
                 std::cout<<std::endl;
             }
+            });
         }else{
             for(std::size_t i=0;i<numRows;++i){
                 auto it_b = elements.lower_bound({i,0});
@@ -135,34 +363,53 @@ namespace algebra {
         }
     }
 
+    //For symmetric matrices the one norm and the infinity norm are equal, every element
+    //outside the diagonal is counted for its row and for the symmetric one
+    template<ScalarOrComplex T>
+    T Matrix<T,StorageOrder::RowMajor>::symmetric_norm(const algebra:: Typenorm& norm_)const{
+        using Real = RealType_t<T>;
+        std::vector<Real> RowSum(numRows,0);
+        Real sum = 0;
+        for_each_stored([&](std::size_t i,std::size_t j,const T& value){
+            const Real factor = i != j ? 2 : 1;
+            RowSum[i] += std::abs(value);
+            if(i != j){
+                RowSum[j] += std::abs(value);
+            }
+            sum += factor*abs2(value);
+        });
+        if(norm_ == algebra::Typenorm::Frobenius){
+            return static_cast<T>(std::sqrt(sum));
+        }
+        return static_cast<T>(RowSum.empty() ? sum : *std::max_element(RowSum.cbegin(),RowSum.cend()));
+    }
+
     template<ScalarOrComplex T>
     T Matrix<T,StorageOrder::RowMajor>::norm(const algebra:: Typenorm& norm_)const{
+        //the norms are real also for complex matrices, they are returned as T
+        using Real = RealType_t<T>;
+        if(symmetryType != Symmetry::General){
+            return symmetric_norm(norm_);
+        }
        if(norm_ == algebra::Typenorm::One){
             if(isCompressed){
                 //initialization
-                std::vector<T> ColumnSum(numCols,static_cast<T>(0));
-                for(std::size_t i=0;i<numRows;++i){
-                    for(std::size_t j=0;j<numCols;++j){
-                         //find the element(i,j)
-                         auto it = std::find_if(compressedMatrix[i].cbegin(), compressedMatrix[i].cend(),
-                            [j](const std::pair<std::size_t, T>& p) {
-                                return p.first == j;
-                            });
-                         //do the sum if and only if the value(i,j) was found
-                         if (it!= compressedMatrix[i].cend()){
-                            ColumnSum[j] += std::abs(it->second);
-                         }
+                std::vector<Real> ColumnSum(numCols,0);
+                //every stored element contributes to the sum of its column
+                visit_values([&](const auto& vals){
+                    for(std::size_t k=0;k<pattern_->nonZeros();++k){
+                        ColumnSum[pattern_->innerIndex[k]] += std::abs(static_cast<T>(vals[k]));
                     }
-                }
-                return *std::max_element(ColumnSum.cbegin(),ColumnSum.cend());
+                });
+                return static_cast<T>(*std::max_element(ColumnSum.cbegin(),ColumnSum.cend()));
             }else{
                 //initialization
-                T sum(static_cast<T>(0)),value;
+                Real sum(0),value;
                 value = sum;
                 for(std::size_t i=0;i<numCols;++i){
                     //do the sum if the condition is satisfies (if the corresponding value was found)
-                    sum = std::accumulate(elements.cbegin(),elements.cend(),static_cast<T>(0),
-                            [i](const T& acc, const std::pair<const std::array<size_t, 2>, T>& entry){
+                    sum = std::accumulate(elements.cbegin(),elements.cend(),static_cast<Real>(0),
+                            [i](const Real& acc, const std::pair<const std::array<size_t, 2>, T>& entry){
                                 auto index = entry.first;
                                 if(index[1]==i){
                                     return acc + std::abs(entry.second);
@@ -171,31 +418,30 @@ namespace algebra {
                             });
                     value = std::max(value,sum);
                 } 
-                return value;
+                return static_cast<T>(value);
             }
        }else if(norm_ == algebra :: Typenorm::Infinity){
-            T sum = static_cast<T>(0);
+            Real sum = 0;
             if(isCompressed){
-               //sum of the first row when the elemet is found
-               sum =  std::accumulate(compressedMatrix[0].cbegin(),compressedMatrix[0].cend(),static_cast<T>(0),
-               [](const T& acc,const std::pair<std::size_t, T>& entry){
-                return acc + std::abs(entry.second);
+               //the values are accumulated with the type T also when stored with reduced precision
+               visit_values([&](const auto& vals){
+                   for(std::size_t i=0;i<numRows;++i){
+                       Real rowSum = 0;
+                       for(std::size_t k=pattern_->outerIndex[i];k<pattern_->outerIndex[i+1];++k){
+                           rowSum += std::abs(static_cast<T>(vals[k]));
+                       }
+                       sum = std::max(sum,rowSum);
+                   }
                });
-               for(std::size_t i=1;i<compressedMatrix.size();++i){
-                sum = std::max(sum ,std::accumulate(compressedMatrix[i].cbegin(),compressedMatrix[i].cend(),static_cast<T>(0),
-               [](const T& acc, const std::pair<std::size_t, T>& entry){
-                return acc + std::abs(entry.second);
-               }));
-               }
-               return sum;
+               return static_cast<T>(sum);
             }else{
                 std::array<std::size_t,2> Key = {0,0};
                 //Order = RowMajor so i can exctract the ith row with low_bound
                 auto it = elements.lower_bound(Key);
                 Key = {1,0};
                 auto it_end = elements.lower_bound(Key);
-                sum = std::accumulate(it,it_end,static_cast<T>(0),
-                [](const T& acc,const std::pair<const std::array<size_t, 2>, T>& entry){
+                sum = std::accumulate(it,it_end,static_cast<Real>(0),
+                [](const Real& acc,const std::pair<const std::array<size_t, 2>, T>& entry){
                     return acc + std::abs(entry.second);
                 });
                 for(std::size_t i=1;i<numRows;++i){
@@ -203,38 +449,39 @@ namespace algebra {
                     it = elements.lower_bound(Key);
                     Key = {i+1,0};
                     it_end = elements.lower_bound(Key);
-                    sum = std::max(sum,std::accumulate(it,it_end,static_cast<T>(0),
-                                      [](const T& acc,const std::pair<const std::array<size_t, 2>, T>& entry ){return acc + std::abs(entry.second);}
+                    sum = std::max(sum,std::accumulate(it,it_end,static_cast<Real>(0),
+                                      [](const Real& acc,const std::pair<const std::array<size_t, 2>, T>& entry ){return acc + std::abs(entry.second);}
                                       ));
                 }
-                return sum;
+                return static_cast<T>(sum);
             }
        }else if(norm_ == algebra::Typenorm::Frobenius){
                 if(isCompressed){
-                    T sum = std::accumulate(compressedMatrix[0].cbegin(),compressedMatrix[0].cend(),static_cast<T>(0),[](const T& acc,const std::pair<std::size_t, T>& entry){
-                        return acc + std::abs(entry.second*entry.second);});
-                    for(std::size_t i=1;i<compressedMatrix.size();++i){
-                        sum += std::accumulate(compressedMatrix[i].cbegin(),compressedMatrix[i].cend(),static_cast<T>(0),[](const T& acc,const std::pair<std::size_t, T>& entry){
-                            return acc + std::abs(entry.second*entry.second);});
-               }
-               return std::sqrt(sum);
+                    T sum = visit_values([](const auto& vals){
+                        Real total = 0;
+                        for(std::size_t k=0;k<vals.size();++k){
+                            total += abs2(static_cast<T>(vals[k]));
+                        }
+                        return total;
+                    });
+               return static_cast<T>(std::sqrt(sum));
                 }else{
                 std::array<std::size_t,2> Key = {0,0};
                 auto it = elements.lower_bound(Key);
                 Key = {1,0};
                 auto it_end = elements.lower_bound(Key);
-                T sum =std::accumulate(it,it_end,static_cast<T>(0),[](const T& acc,const std::pair<const std::array<size_t, 2>, T>& entry){
-                    return acc + std::abs(entry.second*entry.second);});
+                Real sum =std::accumulate(it,it_end,static_cast<Real>(0),[](const Real& acc,const std::pair<const std::array<size_t, 2>, T>& entry){
+                    return acc + abs2(entry.second);});
                 for(std::size_t i=1;i<numRows;++i){
                     Key = {i,0};
                     it = elements.lower_bound(Key);
                     Key = {i+1,0};
                     it_end = elements.lower_bound(Key);
-                    sum +=std::accumulate(it,it_end,static_cast<T>(0),
-                                      [](const T& acc,const std::pair<const std::array<size_t, 2>, T>& entry){return acc + std::abs(entry.second*entry.second);}
+                    sum +=std::accumulate(it,it_end,static_cast<Real>(0),
+                                      [](const Real& acc,const std::pair<const std::array<size_t, 2>, T>& entry){return acc + abs2(entry.second);}
                                       );
                 }
-                return std::sqrt(sum);
+                return static_cast<T>(std::sqrt(sum));
                 }
        }
     }
@@ -3,30 +3,121 @@
 namespace algebra{
 
     template<ScalarOrComplex T>
-    Matrix<T,StorageOrder:: ColumnMajor>:: Matrix(std::size_t nrow,std::size_t ncol): numRows(nrow),numCols(ncol),isCompressed(false){}
+    Matrix<T,StorageOrder:: ColumnMajor>:: Matrix(std::size_t nrow,std::size_t ncol): precision(StoragePrecision::Full),numRows(nrow),numCols(ncol),isCompressed(false),symmetryType(Symmetry::General),storedTriangle(Triangle::Lower){}
+
+    template<ScalarOrComplex T>
+    Matrix<T,StorageOrder::ColumnMajor>:: Matrix(PatternPtr<StorageOrder::ColumnMajor> pattern,StoragePrecision precision_,Symmetry symmetry_,Triangle triangle_,ValuesLater): pattern_(std::move(pattern)),precision(precision_),isCompressed(true),symmetryType(symmetry_),storedTriangle(triangle_){
+        if(!pattern_){
+            throw std::invalid_argument("The pattern is empty");
+        }
+        if(precision == StoragePrecision::Split && !Complex<T>){
+            throw std::invalid_argument("The split storage is only for complex matrices");
+        }
+        numRows = pattern_->numRows;
+        numCols = pattern_->numCols;
+    }
+
+    template<ScalarOrComplex T>
+    Matrix<T,StorageOrder::ColumnMajor>:: Matrix(PatternPtr<StorageOrder::ColumnMajor> pattern,StoragePrecision precision_,Symmetry symmetry_,Triangle triangle_): Matrix(std::move(pattern),precision_,symmetry_,triangle_,ValuesLater{}){
+        if(symmetryType != Symmetry::General && !pattern_->in_triangle(storedTriangle)){
+            throw std::invalid_argument("The pattern of a symmetric matrix must store only its triangle");
+        }
+        //only the values are allocated, the index structure is the shared one
+        assign_values([](std::size_t){return static_cast<T>(0);});
+        //no autotuning here: the values are not set yet
+        spmvKernel = tuning::select_kernel(pattern_->structure,precision,!pattern_->runStart.empty());
+    }
+
+    template<ScalarOrComplex T>
+    void Matrix<T,StorageOrder::ColumnMajor>::select_kernel(){
+        spmvKernel = tuning::select_kernel(pattern_->structure,precision,!pattern_->runStart.empty());
+        //the trial is done once for each pattern (and number of threads), then the cache is used
+        if(tuning::autotuning() && !tuning::cached(pattern_->structure.fingerprint,precision)){
+            autotune(*this);
+        }
+    }
+
+    template<ScalarOrComplex T>
+    void Matrix<T,StorageOrder::ColumnMajor>::set_kernel(SpMVKernel kernel_){
+        if(!isCompressed){
+            throw std::logic_error("The kernel can be set only on a compressed matrix");
+        }
+        if(kernel_ == SpMVKernel::Blocked && pattern_->runStart.empty()){
+            throw std::invalid_argument("The pattern has no runs for the blocked kernel");
+        }
+        spmvKernel = kernel_;
+    }
+
+    template<ScalarOrComplex T>
+    void Matrix<T,StorageOrder::ColumnMajor>::set_values(std::vector<T> newValues){
+        if(!isCompressed || newValues.size() != pattern_->nonZeros()){
+            throw std::invalid_argument("The values are not coherent with the pattern");
+        }
+        //copied by the threads that use the values in the kernels
+        assign_values([&newValues](std::size_t k){return newValues[k];});
+    }
+
+    template<ScalarOrComplex T>
+    std::optional<T> Matrix<T,StorageOrder::ColumnMajor>::find(std::size_t row,std::size_t col)const{
+        //the elements outside the stored triangle are read from the symmetric one
+        const bool mirrored = symmetryType != Symmetry::General && !in_stored_triangle(row,col);
+        if(mirrored){
+            std::swap(row,col);
+        }
+        std::optional<T> value;
+        if(isCompressed){
+            auto k = pattern_->locate(row,col);
+            if(k != pattern_->nonZeros()){
+                value = visit_values([k](const auto& vals){return static_cast<T>(vals[k]);});
+            }
+        }else{
+            auto it = elements.find({row,col});
+            if(it != elements.end()){
+                value = it->second;
+            }
+        }
+        if(value && mirrored && symmetryType == Symmetry::Hermitian){
+            value = conjugate(*value);
+        }
+        return value;
+    }
+
+    template<ScalarOrComplex T>
+    void Matrix<T,StorageOrder::ColumnMajor>::set_symmetry(Symmetry symmetry_,Triangle triangle_){
+        if(isCompressed){
+            throw std::logic_error("The symmetry can be changed only on a not compressed matrix");
+        }
+        symmetryType = symmetry_;
+        storedTriangle = triangle_;
+        if(symmetryType == Symmetry::General){
+            return;
+        }
+        //move the elements of the other triangle, the ones already stored have the precedence
+        for(auto it = elements.begin();it != elements.end();){
+            const auto [row,col] = it->first;
+            if(in_stored_triangle(row,col)){
+                ++it;
+                continue;
+            }
+            T value = symmetryType == Symmetry::Hermitian ? conjugate(it->second) : it->second;
+            elements.try_emplace({col,row},value);
+            it = elements.erase(it);
+        }
+    }
 
     // Const operator() to access elements in a compressed or uncompressed matrix
     template <ScalarOrComplex T>
     T Matrix<T,StorageOrder::ColumnMajor>::operator()(std::size_t row, std::size_t col) const {
         if (row < numRows && col < numCols) {
+                //find takes care of the compressed/uncompressed format and of the symmetry
+                auto value = find(row,col);
+                if(value){
+                    return *value;
+                }
                 if (isCompressed) {
-                    // Access element in compressed matrix
-                    auto it = std::find_if(compressedMatrix[col].cbegin(), compressedMatrix[col].cend(),
-                            [row](const std::pair<std::size_t, T>& p) {
-                                return p.first == row;
-                            });
-                    if(it != compressedMatrix[col].cend()){
-                        return it->second;
-                    }
                     throw std::out_of_range("Element not found");
                 } else {
-                    // Access element in uncompressed map
-                    auto it = elements.find({row, col});
-                    if (it != elements.end()) {
-                        return it->second;
-                    } else {
-                        throw std::out_of_range("element not found");
-                    }
+                    throw std::out_of_range("element not found");
                 }
             } else {
                 throw std::out_of_range("Index out of boundary");
@@ -35,14 +126,22 @@ namespace algebra{
      // Non-const operator() to modify elements in a compressed or uncompressed matrix
     template <ScalarOrComplex T>
     T& Matrix<T,StorageOrder::ColumnMajor>::operator()(std::size_t row, std::size_t col) {
+        //for symmetric matrices only the stored triangle exists
+        if(symmetryType != Symmetry::General && !in_stored_triangle(row,col)){
+            if(symmetryType == Symmetry::Hermitian){
+                throw std::logic_error("Only the stored triangle of an Hermitian matrix can be modified");
+            }
+            std::swap(row,col);
+        }
         if (isCompressed) {
-        // Check if the element exists and is non-zero in the compressed matrix
-            auto it = std::find_if(compressedMatrix[col].begin(), compressedMatrix[col].end(),
-                            [row](const std::pair<std::size_t, T>& p) {
-                                return p.first == row;
-                            });
-            if (row < numRows && col < numCols && it->second != 0) {
-                return it->second;
+        // Check if the element is stored in the compressed matrix (also an explicit zero of the pattern)
+            if(precision != StoragePrecision::Full){
+                //a reference to T cannot be bound to a value stored with reduced precision or split
+                throw std::logic_error("Cannot modify a matrix stored with reduced precision or split");
+            }
+            std::size_t k = (row < numRows && col < numCols) ? pattern_->locate(row,col) : pattern_->nonZeros();
+            if (k != pattern_->nonZeros()) {
+                return values[k];
             } else {
                 throw std::out_of_range("Indexes out of boundary");
             }
@@ -54,22 +153,86 @@ namespace algebra{
     // Function to compress the sparse matrix representation (const-correct version)
     template <ScalarOrComplex T>
     void Matrix<T,StorageOrder::ColumnMajor>::compress(){
+        //a compressed matrix keeps its precision
+        compress(isCompressed ? precision : StoragePrecision::Full);
+    }
+
+    template <ScalarOrComplex T>
+    void Matrix<T,StorageOrder::ColumnMajor>::compress(StoragePrecision precision_){
+        if(precision_ == StoragePrecision::Split && !Complex<T>){
+            throw std::invalid_argument("The split storage is only for complex matrices");
+        }
+        //already compressed: the values are stored again with the new precision on the same pattern
+        if(isCompressed && precision_ != precision){
+            const StoragePrecision old = precision;
+            visit_values([&](const auto& vals){
+                precision = precision_;
+                assign_values([&vals](std::size_t k){return static_cast<T>(vals[k]);});
+            });
+            //the arrays of the old precision are freed
+            if(old == StoragePrecision::Full){
+                parallel::first_touch_vector<T>().swap(values);
+            }else if(old == StoragePrecision::Reduced){
+                parallel::first_touch_vector<ReducedPrecision_t<T>>().swap(reducedValues);
+            }else{
+                parallel::first_touch_vector<RealType_t<T>>().swap(realValues);
+                parallel::first_touch_vector<RealType_t<T>>().swap(imagValues);
+            }
+            //the kernel of a pattern is cached by precision
+            select_kernel();
+        }
         //The change of form must be done only if the Matrix is not already compress
         if(!isCompressed){
-            //Resize the matrix
-            compressedMatrix.resize(numCols);
-            for(std::size_t i=0;i<numCols;++i){
-                auto cit = elements.lower_bound({0,i});
-                auto cend = elements.lower_bound({0,i+1});
-                for (; cit != cend; ++cit){
-                    compressedMatrix[i].emplace_back(cit->first[0],cit->second);
+            precision = precision_;
+            auto pattern = std::make_shared<SparsityPattern<StorageOrder::ColumnMajor>>();
+            pattern->numRows = numRows;
+            pattern->numCols = numCols;
+            //the map is ordered by column, so every thread finds the first element of its columns with
+            //lower_bound and then counts and copies them: the compressed arrays are touched first by
+            //the same threads (with the same split) that use them in the kernels
+            auto first = [this](std::size_t begin){return elements.lower_bound({0,begin});};
+            pattern->outerIndex.resize(numCols+1);
+            pattern->outerIndex[0] = 0;
+            parallel::for_each_chunk(numCols,[&](std::size_t,std::size_t begin,std::size_t end){
+                std::fill(pattern->outerIndex.begin()+begin+1,pattern->outerIndex.begin()+end+1,0);
+                for(auto it=first(begin);it != elements.end() && it->first[1] < end;++it){
+                    ++pattern->outerIndex[it->first[1]+1];
                 }
+            });
+            std::partial_sum(pattern->outerIndex.cbegin(),pattern->outerIndex.cend(),pattern->outerIndex.begin());
+            pattern->balance();
+            pattern->innerIndex.resize(elements.size());
+            auto copy = [&](auto&& store){
+                pattern->for_each_outer([&](std::size_t,std::size_t begin,std::size_t end){
+                    auto it = first(begin);
+                    for(std::size_t k=pattern->outerIndex[begin];k<pattern->outerIndex[end];++k,++it){
+                        pattern->innerIndex[k] = it->first[0];
+                        store(k,it->second);
+                    }
+                });
+            };
+            if(precision == StoragePrecision::Full){
+                values.resize(elements.size());
+                copy([this](std::size_t k,const T& value){values[k] = value;});
+            }else if(precision == StoragePrecision::Reduced){
+                reducedValues.resize(elements.size());
+                copy([this](std::size_t k,const T& value){reducedValues[k] = static_cast<ReducedPrecision_t<T>>(value);});
+            }else{
+                realValues.resize(elements.size());
+                imagValues.resize(elements.size());
+                copy([this](std::size_t k,const T& value){
+                    realValues[k] = std::real(value);
+                    imagValues[k] = std::imag(value);
+                });
             }
+            pattern->analyze(symmetryType);
+            pattern_ = std::move(pattern);
        //Clear the map to free the memory
        elements.clear();
 
         //Set the compressed flag
         isCompressed = true;
+        select_kernel();
         }
     }
 
@@ -82,31 +245,53 @@ namespace algebra{
             }
 
             // Rebuild the elements map from compressed matrix
-            for(std::size_t i=0;i<numCols;++i){
-                for(auto it = compressedMatrix[i].begin();it!=compressedMatrix[i].end();++it){
-                    auto jj = it->first;
-                    elements[{jj,i}] = it->second;
+            visit_values([this](const auto& vals){
+                for(std::size_t i=0;i<numCols;++i){
+                    for(std::size_t k=pattern_->outerIndex[i];k<pattern_->outerIndex[i+1];++k){
+                        elements.emplace_hint(elements.end(),std::array<std::size_t,2>{pattern_->innerIndex[k],i},static_cast<T>(vals[k]));
+                    }
                 }
-            }
+            });
 
             // Clear the compressed matrix to free memory
-            compressedMatrix.clear();
+            //the pattern is only released, other matrices may still use it
+            pattern_.reset();
+            values.clear();
+            reducedValues.clear();
+            realValues.clear();
+            imagValues.clear();
+            precision = StoragePrecision::Full;
 
             // Reset the compression flag
             isCompressed = false;
     }
     // Function to print the matrix (supports both compressed and uncompressed)
+    template<ScalarOrComplex T>
+    void Matrix<T,StorageOrder::ColumnMajor>::print_triplets(std::ostream& os)const{
+        os<<numRows<<" "<<numCols<<" "<<nonZeros()<<"\n";
+        for_each_stored([&os](std::size_t row,std::size_t col,const T& value){
+            os<<row<<" "<<col<<" "<<value<<"\n";
+        });
+    }
+
     template <ScalarOrComplex T>
     void Matrix<T,StorageOrder::ColumnMajor>::print() const {
+        if(symmetryType != Symmetry::General){
+            //the elements of the other triangle are not stored, find gives them by symmetry
+            for(std::size_t i=0;i<numRows;++i){
+                for(std::size_t j=0;j<numCols;++j){
+                    std::cout<<find(i,j).value_or(static_cast<T>(0));
+                }
+                std::cout<<std::endl;
+            }
+            return;
+        }
         if(isCompressed){
             for(std::size_t i=0;i<numRows;++i){
                 for(std::size_t j=0;j<numCols;++j){
-                    auto it = std::find_if(compressedMatrix[j].cbegin(), compressedMatrix[j].cend(),
-                            [i](const std::pair<std::size_t, T>& p) {
-                                return p.first == i;
-                            });
-                    if(it!=compressedMatrix[i].cend()){
-                        std::cout<<it->second;
+                    auto k = pattern_->locate(i,j);
+                    if(k!=pattern_->nonZeros()){
+                        std::cout<<visit_values([k](const auto& vals){return static_cast<T>(vals[k]);});
                     }else{std::cout<<0;}
                 }
                 std::cout<<std::endl;
@@ -125,24 +310,49 @@ namespace algebra{
         }
     }
     
+    //For symmetric matrices the one norm and the infinity norm are equal, every element
+    //outside the diagonal is counted for its row and for the symmetric one
+    template<ScalarOrComplex T>
+    T Matrix<T,StorageOrder::ColumnMajor>::symmetric_norm(const algebra:: Typenorm& norm_)const{
+        using Real = RealType_t<T>;
+        std::vector<Real> RowSum(numRows,0);
+        Real sum = 0;
+        for_each_stored([&](std::size_t i,std::size_t j,const T& value){
+            const Real factor = i != j ? 2 : 1;
+            RowSum[i] += std::abs(value);
+            if(i != j){
+                RowSum[j] += std::abs(value);
+            }
+            sum += factor*abs2(value);
+        });
+        if(norm_ == algebra::Typenorm::Frobenius){
+            return static_cast<T>(std::sqrt(sum));
+        }
+        return static_cast<T>(RowSum.empty() ? sum : *std::max_element(RowSum.cbegin(),RowSum.cend()));
+    }
+
     template<ScalarOrComplex T>
     T Matrix<T,StorageOrder::ColumnMajor>::norm(const algebra:: Typenorm& norm_)const{
+        //the norms are real also for complex matrices, they are returned as T
+        using Real = RealType_t<T>;
+        if(symmetryType != Symmetry::General){
+            return symmetric_norm(norm_);
+        }
         if(norm_ == algebra::Typenorm::One){
                 //initialization of sum
-                T sum = static_cast<T>(0);
+                Real sum = 0;
                 if(isCompressed){
-                    //accumulate method + lambda function allows to evaluate the sum for column
-                    sum = std::accumulate(compressedMatrix[0].cbegin(),compressedMatrix[0].cend(),static_cast<T>(0),
-                                         [](const T& acc,const std::pair<std::size_t,T>&entry){
-                                            return acc + std::abs(entry.second);
-                                         });
-                    for(std::size_t i=1;i<compressedMatrix.size();++i){
-                        sum = std::max(sum,std::accumulate(compressedMatrix[i].cbegin(),compressedMatrix[i].cend(),static_cast<T>(0),
-                                         [](const T& acc,const std::pair<std::size_t,T>&entry){
-                                            return acc + std::abs(entry.second);
-                                         }));
-                    return sum;
-                    }
+                    //the values are accumulated with the type T also when stored with reduced precision
+                    visit_values([&](const auto& vals){
+                        for(std::size_t j=0;j<numCols;++j){
+                            Real colSum = 0;
+                            for(std::size_t k=pattern_->outerIndex[j];k<pattern_->outerIndex[j+1];++k){
+                                colSum += std::abs(static_cast<T>(vals[k]));
+                            }
+                            sum = std::max(sum,colSum);
+                        }
+                    });
+                    return static_cast<T>(sum);
                 }else{
                     //since the Matrix is stored with Column Major order
                     //i exctract the ith column with the map's method lower_bound
@@ -150,8 +360,8 @@ namespace algebra{
                     auto it = elements.lower_bound(Key);
                     Key = {0,1};
                     auto it_end = elements.lower_bound(Key);
-                    sum = std::accumulate(it,it_end,static_cast<T>(0),
-                                         [](const T& acc, const std::pair<const std::array<std::size_t,2>,T>& entry){
+                    sum = std::accumulate(it,it_end,static_cast<Real>(0),
+                                         [](const Real& acc, const std::pair<const std::array<std::size_t,2>,T>& entry){
                                             return acc + std::abs(entry.second);
                                          }); 
                     for (std::size_t i=1;i<numCols;++i){
@@ -159,39 +369,33 @@ namespace algebra{
                         it = elements.lower_bound(Key);
                         Key = {0,i+1};
                         it_end = elements.lower_bound(Key);
-                        sum  = std:: max(sum,std::accumulate(it,it_end,static_cast<T>(0),
-                                         [](const T& acc, const std::pair<const std::array<std::size_t,2>,T>& entry){
+                        sum  = std:: max(sum,std::accumulate(it,it_end,static_cast<Real>(0),
+                                         [](const Real& acc, const std::pair<const std::array<std::size_t,2>,T>& entry){
                                             return acc + std::abs(entry.second);
                                          }));
                     }
-                    return sum;
+                    return static_cast<T>(sum);
                 }   
         }else if(norm_ == algebra::Typenorm::Infinity){
                 if(isCompressed){
                 //StorageOrder = ColumnMajor so i need an auxiliary vector to store
                 //the sum by row
-                std::vector<T> RowSum(numRows,static_cast<T>(0));
-                for(std::size_t i=0;i<numCols;++i){
-                    for(std::size_t j=0;j<numRows;++j){
-                         //finds the lement (i,j)
-                         auto it = std::find_if(compressedMatrix[i].begin(), compressedMatrix[i].end(),
-                            [j](const std::pair<std::size_t, T>& p) {
-                                return p.first == j;
-                            });
-                         if (it!= compressedMatrix[i].cend()){
-                            RowSum[j] += std::abs(it->second);
-                         }
+                std::vector<Real> RowSum(numRows,0);
+                //every stored element contributes to the sum of its row
+                visit_values([&](const auto& vals){
+                    for(std::size_t k=0;k<pattern_->nonZeros();++k){
+                        RowSum[pattern_->innerIndex[k]] += std::abs(static_cast<T>(vals[k]));
                     }
-                }
-                return *std::max_element(RowSum.cbegin(),RowSum.cend());
+                });
+                return static_cast<T>(*std::max_element(RowSum.cbegin(),RowSum.cend()));
                 }else{
                 //initialization of the value;
-                T sum(static_cast<T>(0)),value;
+                Real sum(0),value;
                 value = sum;
                 for(std::size_t i=0;i<numRows;++i){
                     //sum if the condition described by the lambda function is true
-                    sum = std::accumulate(elements.cbegin(),elements.cend(),static_cast<T>(0),
-                            [i](const T& acc, const std::pair<const std::array<size_t, 2>, T>& entry){
+                    sum = std::accumulate(elements.cbegin(),elements.cend(),static_cast<Real>(0),
+                            [i](const Real& acc, const std::pair<const std::array<size_t, 2>, T>& entry){
                                 auto index = entry.first;
                                 if(index[0]==i){
                                     return acc + std::abs(entry.second);
@@ -200,39 +404,78 @@ namespace algebra{
                             });
                     value = std::max(value,sum);
                 } 
-                return value;
+                return static_cast<T>(value);
                 }
         }else if(norm_ == algebra::Typenorm::Frobenius){
-                T sum(static_cast<T>(0));
+                Real sum(0);
                 if(isCompressed){
-                    T sum = std::accumulate(compressedMatrix[0].cbegin(),compressedMatrix[0].cend(),static_cast<T>(0),[](const T& acc,const std::pair<std::size_t, T>& entry){
-                        return acc + std::abs(entry.second*entry.second);});
-                    for(std::size_t i=1;i<compressedMatrix.size();++i){
-                        sum += std::accumulate(compressedMatrix[i].cbegin(),compressedMatrix[i].cend(),static_cast<T>(0),[](const T& acc,const std::pair<std::size_t, T>& entry){
-                            return acc + std::abs(entry.second*entry.second);});
-               }
-               return std::sqrt(sum);
+                    sum = visit_values([](const auto& vals){
+                        Real total = 0;
+                        for(std::size_t k=0;k<vals.size();++k){
+                            total += abs2(static_cast<T>(vals[k]));
+                        }
+                        return total;
+                    });
+               return static_cast<T>(std::sqrt(sum));
                 }else{
                 std::array<std::size_t,2> Key = {0,0};
                 auto it = elements.lower_bound(Key);
                 Key = {0,1};
                 auto it_end = elements.lower_bound(Key);
-                T sum =std::accumulate(it,it_end,static_cast<T>(0),[](const T& acc,const std::pair<const std::array<size_t, 2>, T>& entry){
-                    return acc + std::abs(entry.second*entry.second);});
-                for(std::size_t i=1;i<numRows;++i){
+                Real sum =std::accumulate(it,it_end,static_cast<Real>(0),[](const Real& acc,const std::pair<const std::array<size_t, 2>, T>& entry){
+                    return acc + abs2(entry.second);});
+                for(std::size_t i=1;i<numCols;++i){
                     Key = {0,i};
                     it = elements.lower_bound(Key);
                     Key = {0,i+1};
                     it_end = elements.lower_bound(Key);
-                    sum +=std::accumulate(it,it_end,static_cast<T>(0),
-                                      [](const T& acc,const std::pair<const std::array<size_t, 2>, T>& entry){return acc + std::abs(entry.second*entry.second);}
+                    sum +=std::accumulate(it,it_end,static_cast<Real>(0),
+                                      [](const Real& acc,const std::pair<const std::array<size_t, 2>, T>& entry){return acc + abs2(entry.second);}
                                       );
                     }
-                return std::sqrt(sum);
+                return static_cast<T>(std::sqrt(sum));
         }
             }
             } 
 
+    template<ScalarOrComplex T>
+    Matrix<T,StorageOrder::ColumnMajor>& Matrix<T,StorageOrder::ColumnMajor>::operator*=(const T& alpha){
+        if(symmetryType == Symmetry::Hermitian && std::imag(alpha) != 0){
+            throw std::invalid_argument("A Hermitian matrix can be scaled only by a real number");
+        }
+        if(!isCompressed){
+            for(auto& [key,value] : elements){
+                value *= alpha;
+            }
+        }else if(precision == StoragePrecision::Full){
+            parallel::for_each_position(pattern_->outerIndex,pattern_->byElements,[&](std::size_t k){values[k] *= alpha;});
+        }else if(precision == StoragePrecision::Reduced){
+            parallel::for_each_position(pattern_->outerIndex,pattern_->byElements,[&](std::size_t k){
+                reducedValues[k] = static_cast<ReducedPrecision_t<T>>(static_cast<T>(reducedValues[k])*alpha);
+            });
+        }else if constexpr(Complex<T>){
+            parallel::for_each_position(pattern_->outerIndex,pattern_->byElements,[&](std::size_t k){
+                const T value = T(realValues[k],imagValues[k])*alpha;
+                realValues[k] = value.real();
+                imagValues[k] = value.imag();
+            });
+        }
+        return *this;
+    }
+
+    template<ScalarOrComplex T>
+    SparseVectorView<T> Matrix<T,StorageOrder::ColumnMajor>::col(std::size_t j)const{
+        if(!isCompressed || precision != StoragePrecision::Full){
+            throw std::logic_error("The column view needs a compressed matrix with full precision");
+        }
+        if(j >= numCols){
+            throw std::out_of_range("Index out of boundary");
+        }
+        const std::size_t first = pattern_->outerIndex[j];
+        const std::size_t count = pattern_->outerIndex[j+1] - first;
+        return {std::span(pattern_->innerIndex).subspan(first,count),std::span(values).subspan(first,count)};
+    }
+
     template<ScalarOrComplex T>
     void Matrix<T,StorageOrder::ColumnMajor>::resize(std::size_t nrow,std::size_t ncol){
             numRows =nrow;
@@ -2,13 +2,18 @@
 
 namespace algebra {
 
-template<ScalarOrComplex T,StorageOrder Order>
-void read(Matrix<T, Order>& matrix ,const std::string& file_name){
-    std::ifstream file(file_name);
-    if (!file.is_open()) {
-        std::cerr << "Error, Impposible open file: " << file_name << std::endl;
-    }
+//Information in the header of a Matrix Market file
+struct MatrixMarketHeader {
+    std::string field;
+    Symmetry symmetry = Symmetry::General;
+    std::size_t numRows = 0;
+    std::size_t numCols = 0;
+    std::size_t numNonZero = 0;
+};
 
+//Reads the banner and the sizes, the stream is left on the first element
+inline MatrixMarketHeader read_header(std::istream& file){
+    MatrixMarketHeader result;
     std::string line;
     std::getline(file, line); // read the first line 
     
@@ -16,63 +21,181 @@ void read(Matrix<T, Order>& matrix ,const std::string& file_name){
     if (line.substr(0, 14) != "%%MatrixMarket") {
         std::cerr << "Eror the file is not in format Matrix Market" << std::endl;
     }
+    // The first line is: %%MatrixMarket matrix coordinate <field> <symmetry>
+    std::istringstream header(line);
+    std::string banner, object, format, symmetryStr;
+    header >> banner >> object >> format >> result.field >> symmetryStr;
+    auto lower = [](std::string& str){
+        std::transform(str.begin(),str.end(),str.begin(),[](unsigned char c){return std::tolower(c);});
+    };
+    lower(result.field);
+    lower(symmetryStr);
+    if(symmetryStr == "symmetric"){
+        result.symmetry = Symmetry::Symmetric;
+    }else if(symmetryStr == "hermitian"){
+        result.symmetry = Symmetry::Hermitian;
+    }else if(!symmetryStr.empty() && symmetryStr != "general"){
+        throw std::runtime_error("Symmetry not supported: " + symmetryStr);
+    }
 
     while (std::getline(file, line) && line[0] == '%') {
         // ignore that line since are unusless
     }
     // Read numbers of rows,columns and non zero elements
-    
-    std::size_t numNonZero;
     std::string numRowsStr, numColsStr, numNonZeroStr;
     std::istringstream iss(line);
     if(!(iss >> numRowsStr >> numColsStr >> numNonZeroStr)) {
         throw std::runtime_error("Error during the reading");
     }
-    auto numRows = std::stoul(numRowsStr);
-    auto numCols = std::stoul(numColsStr);
-    numNonZero = std::stoul(numNonZeroStr);
-    std::cout << numRows<< " "<< numCols<< " "<< numNonZero<<std::endl;
-    matrix.resize(numRows,numCols);
+    result.numRows = std::stoul(numRowsStr);
+    result.numCols = std::stoul(numColsStr);
+    result.numNonZero = std::stoul(numNonZeroStr);
+    return result;
+}
+
+//Value of an element of a Matrix Market file from the fields after the indexes: the real and the
+//imaginary part for the complex field, nothing for the pattern field (the value is 1)
+template<ScalarOrComplex T>
+T element_value(const std::string& field,std::string_view real,std::string_view imag){
+    if(field == "pattern"){
+        return static_cast<T>(1);
+    }
+    //the parts are read with the precision of T (double for the integer matrices)
+    using Real = std::conditional_t<std::is_floating_point_v<RealType_t<T>>,RealType_t<T>,double>;
+    auto parse = [](std::string_view text){
+        Real value = 0;
+        if(std::from_chars(text.data(),text.data()+text.size(),value).ec != std::errc()){
+            throw std::runtime_error("Invalid value in the file: " + std::string(text));
+        }
+        return value;
+    };
+    if(field == "complex"){
+        if constexpr(Complex<T>){
+            return T(parse(real),parse(imag));
+        }else{
+            throw std::runtime_error("A complex file can not be read in a real matrix");
+        }
+    }
+    return static_cast<T>(parse(real));
+}
+
+template<ScalarOrComplex T,StorageOrder Order>
+void read(Matrix<T, Order>& matrix ,const std::string& file_name){
+    std::ifstream file(file_name);
+    if (!file.is_open()) {
+        std::cerr << "Error, Impposible open file: " << file_name << std::endl;
+    }
+    std::string line;
+    const MatrixMarketHeader header = read_header(file);
+    const Symmetry symmetry = header.symmetry;
+    std::cout << header.numRows<< " "<< header.numCols<< " "<< header.numNonZero<<std::endl;
+    matrix.resize(header.numRows,header.numCols);
+    //the file stores only one triangle of a symmetric matrix, the matrix keeps its own triangle
+    matrix.set_symmetry(symmetry,matrix.storedTriangle);
     // Read the non zero element
     while(std::getline(file,line)){
         std::istringstream elementStream(line);
-        std::string nrow,ncol,val;
-        elementStream >> nrow >> ncol >> val;
+        std::string nrow,ncol,val,imag;
+        elementStream >> nrow >> ncol >> val >> imag;
         std::size_t row,col;
-        double value;
         row = std::stoul(nrow);
         col = std::stoul(ncol);
-        value = std::stod(val);
-        matrix.elements[{row-1,col-1}]= static_cast<T>(value);
+        std::array<std::size_t,2> key = {row-1,col-1};
+        T entry = element_value<T>(header.field,val,imag);
+        if(symmetry != Symmetry::General && !matrix.in_stored_triangle(key[0],key[1])){
+            std::swap(key[0],key[1]);
+            entry = symmetry == Symmetry::Hermitian ? conjugate(entry) : entry;
+        }
+        matrix.elements[key]= entry;
     }
     file.close();
 }
 
+//Writes a compressed matrix in a Matrix Market file with the elements sorted by row (a symmetric
+//matrix is written with its lower triangle, as the format requires). The lines of a batch of elements
+//are formatted with std::to_chars in parallel, a buffer for each thread, and then written in order.
+//The pattern is walked directly when it is stored in the order of the file (see visit_entry_lists)
+template<ScalarOrComplex T,StorageOrder Order>
+void write_mtx(const Matrix<T,Order>& matrix,const std::string& file_name){
+    if(!matrix.is_compressed()){
+        throw std::logic_error("The matrix must be compressed");
+    }
+    std::ofstream file(file_name,std::ios::binary);
+    if(!file.is_open()){
+        throw std::runtime_error("Impossible open file: " + file_name);
+    }
+    const Symmetry symmetry = matrix.symmetry();
+    const char* field = Complex<T> ? "complex" : std::is_integral_v<T> ? "integer" : "real";
+    const char* symmetryName = symmetry == Symmetry::Symmetric ? "symmetric" : symmetry == Symmetry::Hermitian ? "hermitian" : "general";
+    file << "%%MatrixMarket matrix coordinate " << field << " " << symmetryName << "\n";
+    file << matrix.rows() << " " << matrix.cols() << " " << matrix.nonZeros() << "\n";
+    //an upper triangle is written transposed, so the rows of the file are the stored columns
+    const bool transposed = symmetry != Symmetry::General && matrix.triangle() == Triangle::Upper;
+    auto append = [](std::string& out,auto number){
+        char buffer[64];
+        out.append(buffer,std::to_chars(buffer,buffer+sizeof(buffer),number).ptr);
+    };
+    //number of elements formatted before writing them, it bounds the memory used
+    constexpr std::size_t batchEntries = std::size_t(1)<<18;
+    std::vector<std::string> parts;
+    matrix.visit_values([&](const auto& vals){
+        visit_entry_lists(*matrix.pattern(),!transposed,[&](const auto& ptr,const auto& index,auto position){
+            const std::size_t numEntries = ptr.back();
+            for(std::size_t first=0;first<numEntries;first+=batchEntries){
+                //the batch is split by elements, so the long rows are shared among the threads too
+                const std::size_t count = std::min(batchEntries,numEntries-first);
+                parts.resize(parallel::chunks(count));
+                parallel::for_each_chunk(count,[&](std::size_t chunk,std::size_t begin,std::size_t stop){
+                    std::string& out = parts[chunk];
+                    out.clear();
+                    out.reserve((stop-begin)*48);
+                    //row of the first element of the block (the empty rows before it are skipped)
+                    auto row = static_cast<std::size_t>(std::upper_bound(ptr.cbegin(),ptr.cend(),first+begin)-ptr.cbegin())-1;
+                    for(std::size_t e=first+begin;e<first+stop;++e){
+                        while(ptr[row+1] <= e){
+                            ++row;
+                        }
+                        T value = static_cast<T>(vals[position(e)]);
+                        if(transposed && symmetry == Symmetry::Hermitian){
+                            value = conjugate(value);
+                        }
+                        append(out,row+1);
+                        out.push_back(' ');
+                        append(out,index[e]+1);
+                        out.push_back(' ');
+                        if constexpr(Complex<T>){
+                            append(out,value.real());
+                            out.push_back(' ');
+                            append(out,value.imag());
+                        }else{
+                            append(out,value);
+                        }
+                        out.push_back('\n');
+                    }
+                });
+                for(const auto& out : parts){
+                    file.write(out.data(),static_cast<std::streamsize>(out.size()));
+                }
+            }
+        });
+    });
+    if(!file){
+        throw std::runtime_error("Error writing file: " + file_name);
+    }
+}
+
 template<ScalarOrComplex T, StorageOrder Order>
 std::vector<T> operator*(const Matrix<T,Order>& matrix, const std::vector<T>& vec){
     if constexpr(Order == algebra::StorageOrder::RowMajor){
         // Create a vector to store the result of matrix-vector multiplication
         std::vector<T> result(matrix.numRows,static_cast<T>(0));
         //Check for the correctness of dimension
-        if(vec.size() != matrix.numRows){
+        if(vec.size() != matrix.numCols){
             std::cerr<<"Error dimension not coeirent"<<std::endl;
             return result;
         }
         if (matrix.isCompressed) {
-            // Iterate over the rows of the compressed matrix
-            for (std::size_t i = 0; i < matrix.numRows; ++i) {
-                T rowSum = static_cast<T>(0);
-    
-                // Compute the dot product between the current row of the matrix and the vector 'vec'
-                for (std::size_t j=0; j< matrix.compressedMatrix[i].size(); ++j) {         // Value of the matrix element
-                        std:: size_t jj = matrix.compressedMatrix[i][j].first;
-                        // Multiply the matrix element value with the corresponding vector element and accumulate
-                        rowSum += matrix.compressedMatrix[i][j].second * vec[jj];
-                        }
-                    // Assign the computed dot product to the corresponding index in the result vector
-                    result[i] = rowSum;
-                }
-
+            multiply(matrix,vec,result);
             return result;
         }else{
             for(std::size_t i=0;i<matrix.numRows;++i){
@@ -87,9 +210,13 @@ std::vector<T> operator*(const Matrix<T,Order>& matrix, const std::vector<T>& ve
                 for(;it != it_end;++it){
                     std::size_t j = it->first[1];
                     rowSum += it->second*vec[j];
+                    //contribution of the symmetric element, that is not stored
+                    if(matrix.symmetryType != Symmetry::General && j != i){
+                        result[j] += (matrix.symmetryType == Symmetry::Hermitian ? conjugate(it->second) : it->second)*vec[i];
+                    }
                 }
-                //assignment to the return value
-                result[i] = rowSum;
+                //assignment to the return value (other rows may have already added the symmetric part)
+                result[i] += rowSum;
             }
             return result;
         }
@@ -97,7 +224,7 @@ std::vector<T> operator*(const Matrix<T,Order>& matrix, const std::vector<T>& ve
         // Create a vector to store the result of matrix-vector multiplication
     std::vector<T> result(matrix.numRows, 0);
     //Check for the correctness of dimension
-    if(vec.size() != matrix.numRows){
+    if(vec.size() != matrix.numCols){
         std::cerr<<"Error dimension not coeirent"<<std::endl;
         return result;
     }
@@ -107,112 +234,650 @@ std::vector<T> operator*(const Matrix<T,Order>& matrix, const std::vector<T>& ve
             auto it_end = matrix.elements.lower_bound({0,j+1});
             for(;it!=it_end;++it){
                 std::size_t jj = it->first[0];
-                result[jj] += it->second* vec[jj];
+                result[jj] += it->second* vec[j];
+                //contribution of the symmetric element, that is not stored
+                if(matrix.symmetryType != Symmetry::General && jj != j){
+                    result[j] += (matrix.symmetryType == Symmetry::Hermitian ? conjugate(it->second) : it->second)*vec[jj];
+                }
             }
         }
         return result;
     }else{
-        for(std::size_t j=0;j<matrix.numCols;++j){
-            auto it = matrix.compressedMatrix[j].cbegin();
-            auto it_end = matrix.compressedMatrix[j].cend();
-            for(;it != it_end;++it){
-                std::size_t i = it->first;
-                result[i] += it->second*vec[i];
-            }
-        }
+        multiply(matrix,vec,result);
         return result;
     }
     }
 }
-//When you do the multiplication between Matrix and vector the following implementation 
-//requires the fact that both matrix and vector are stored in the same order
-template<ScalarOrComplex T, StorageOrder Order>
-std::vector<T> operator*(const Matrix<T,Order>& matrix,const Matrix<T,Order>& vec){
-    if constexpr (Order == algebra::StorageOrder::RowMajor){
-        std::vector<T> result(matrix.numRows,static_cast<T>(0));
-        if(vec.numRows != matrix.numRows && vec.numCols >1){
-            std::cerr<<"Dimension not valid"<<std::endl;
-            return result;
+//Private buffers of scatter_chunks, kept by the calling thread between the products
+template<typename T>
+struct ScatterWorkspace {
+    std::vector<parallel::first_touch_vector<T>> partial;
+    //rows [first,last) written by each chunk, partial[chunk][i-first] is the row i
+    std::vector<std::array<std::size_t,2>> range;
+    bool inUse = false;
+};
+
+//Buffers of scatter_chunks kept by the calling thread for the products of type T
+template<typename T>
+ScatterWorkspace<T>& scatter_workspace(){
+    static thread_local ScatterWorkspace<T> kept;
+    return kept;
+}
+
+//Frees the buffers kept by scatter_chunks for the products of type T, on the calling thread and on
+//the workers of the pool (the asynchronous products run there). As set_num_threads, it must be
+//called when no kernel is running
+template<typename T>
+void release_scatter_buffers(){
+    auto release = [](){
+        auto& work = scatter_workspace<T>();
+        if(!work.inUse){
+            std::vector<parallel::first_touch_vector<T>>().swap(work.partial);
+            std::vector<std::array<std::size_t,2>>().swap(work.range);
         }
-        //for semplicity the vector will be used in the compact format
-        auto& mutableVec = const_cast<Matrix<T, StorageOrder::RowMajor>&>(vec);
-        if(mutableVec.isCompressed){
-            mutableVec.uncompress();
+    };
+    release();
+    //no worker is busy, so the task of the worker w is run by w
+    parallel::ThreadPool& workers = parallel::pool();
+    std::size_t remaining = workers.size();
+    for(std::size_t w=0;w<workers.size();++w){
+        workers.run_on(w,[&](){
+            release();
+            workers.notify([&remaining](){--remaining;});
+        });
+    }
+    workers.wait([&remaining](){return remaining == 0;});
+}
+
+//Rows [first,last) of a vector stored from partial[0], indexed with the row
+template<typename T>
+struct OffsetSpan {
+    T* data;
+    std::size_t first;
+    T& operator[](std::size_t i)const{return data[i-first];};
+};
+
+//Runs kernel(local,begin,end) on the outer indexes of pattern split among the threads, for the
+//kernels that scatter in the result: the first chunk accumulates directly in result, the others
+//in a private buffer for each thread that are summed at the end, so the threads never write
+//the same element. The kernel of a chunk writes the inner indexes stored in its outer indexes and,
+//if writesOuter (the symmetric kernels), the outer indexes too, so the buffer covers just that range
+//(a band for a banded matrix) and it is reused by the next products of the thread, until
+//release_scatter_buffers. result must be already zeroed (with parallel::fill, the split of the sum)
+template<typename Pattern,typename Vector,typename Kernel>
+void scatter_chunks(const Pattern& pattern,bool writesOuter,Vector& result,Kernel&& kernel){
+    using T = typename Vector::value_type;
+    const std::size_t nchunks = parallel::outer_chunks(pattern.outerIndex,pattern.byElements);
+    if(nchunks == 1){
+        kernel(result,0,pattern.outerIndex.size()-1);
+        return;
+    }
+    ScatterWorkspace<T>& kept = scatter_workspace<T>();
+    //a nested product on the same thread (run while it waits) has its own buffers
+    ScatterWorkspace<T> nested;
+    ScatterWorkspace<T>& work = kept.inUse ? nested : kept;
+    struct Release {
+        bool& inUse;
+        ~Release(){inUse = false;}
+    } release{work.inUse};
+    work.inUse = true;
+    if(work.partial.size() < nchunks){
+        work.partial.resize(nchunks);
+    }
+    work.range.assign(nchunks,{0,0});
+    pattern.for_each_outer([&](std::size_t chunk,std::size_t begin,std::size_t end){
+        if(chunk == 0){
+            kernel(result,begin,end);
+            return;
         }
-        if(matrix.isCompressed){
-            // Iterate over the rows of the compressed matrix
-            for (std::size_t i = 0; i < matrix.numRows; ++i) {
-                T rowSum = static_cast<T>(0);
-                // Compute the dot product between the current row of the matrix and the vector 'vec'
-                for (std::size_t j=0; j< matrix.compressedMatrix[i].size(); ++j) {         // Value of the matrix element
-                        std:: size_t jj = matrix.compressedMatrix[i][j].first;
-                        // Multiply the matrix element value with the corresponding vector element and accumulate
-                        if(mutableVec.elements.find({jj,0})!= mutableVec.elements.end()){
-                            rowSum += matrix.compressedMatrix[i][j].second * mutableVec.elements.at({jj,0});
-                            }
-                        }
-                    // Assign the computed dot product to the corresponding index in the result vector
-                    result[i] = rowSum;
+        //the inner indexes of an outer are sorted, so the first and the last ones bound them
+        std::size_t first = writesOuter ? begin : result.size(), last = writesOuter ? end : 0;
+        for(std::size_t outer=begin;outer<end;++outer){
+            if(pattern.outerIndex[outer] != pattern.outerIndex[outer+1]){
+                first = std::min(first,pattern.innerIndex[pattern.outerIndex[outer]]);
+                last = std::max(last,pattern.innerIndex[pattern.outerIndex[outer+1]-1]+1);
+            }
+        }
+        //a chunk without elements writes nothing
+        first = std::min(first,last);
+        auto& buffer = work.partial[chunk];
+        if(buffer.size() < last-first){
+            buffer.clear();
+            buffer.resize(last-first);
+        }
+        std::fill_n(buffer.begin(),last-first,static_cast<T>(0));
+        work.range[chunk] = {first,last};
+        OffsetSpan<T> local{buffer.data(),first};
+        kernel(local,begin,end);
+    });
+    parallel::for_each_chunk(result.size(),[&](std::size_t,std::size_t begin,std::size_t end){
+        for(std::size_t c=1;c<nchunks;++c){
+            const auto [first,last] = work.range[c];
+            const auto& buffer = work.partial[c];
+            for(std::size_t i=std::max(begin,first);i<std::min(end,last);++i){
+                result[i] += buffer[i-first];
+            }
+        }
+    });
+}
+
+//Kernels of the product of a CSR matrix with general symmetry (see SpMVKernel). Every thread computes
+//its own rows of the result, with the split of the pattern, so it touches first its part of result.
+//All the kernels sum the elements of a row in the same order
+template<StorageOrder Order,typename Values,typename X,typename Y>
+void multiply_rows(const SparsityPattern<Order>& pattern,const Values& vals,const X& vec,Y& result,SpMVKernel kernel){
+    using T = typename Y::value_type;
+    auto row_sum = [&](std::size_t i){
+        T rowSum = static_cast<T>(0);
+        for(std::size_t k=pattern.outerIndex[i];k<pattern.outerIndex[i+1];++k){
+            rowSum += static_cast<T>(vals[k]) * vec[pattern.innerIndex[k]];
+        }
+        return rowSum;
+    };
+    if(kernel == SpMVKernel::Sliced){
+        //slices of 4 rows walked together up to the shortest one: 4 independent sums in the inner loop
+        constexpr std::size_t slice = 4;
+        pattern.for_each_outer([&](std::size_t,std::size_t begin,std::size_t end){
+            std::size_t i = begin;
+            for(;i+slice<=end;i+=slice){
+                std::array<std::size_t,slice> first,last;
+                std::array<T,slice> sum;
+                std::size_t common = std::numeric_limits<std::size_t>::max();
+                for(std::size_t r=0;r<slice;++r){
+                    first[r] = pattern.outerIndex[i+r];
+                    last[r] = pattern.outerIndex[i+r+1];
+                    common = std::min(common,last[r]-first[r]);
+                    sum[r] = static_cast<T>(0);
                 }
-            return result;
-        }else{
-            for(std::size_t i=0;i<matrix.numRows;++i){
-                //initialization of the value of the ith componets of the result
+                for(std::size_t c=0;c<common;++c){
+                    for(std::size_t r=0;r<slice;++r){
+                        sum[r] += static_cast<T>(vals[first[r]+c]) * vec[pattern.innerIndex[first[r]+c]];
+                    }
+                }
+                for(std::size_t r=0;r<slice;++r){
+                    for(std::size_t k=first[r]+common;k<last[r];++k){
+                        sum[r] += static_cast<T>(vals[k]) * vec[pattern.innerIndex[k]];
+                    }
+                    result[i+r] = sum[r];
+                }
+            }
+            for(;i<end;++i){
+                result[i] = row_sum(i);
+            }
+        });
+    }else if(kernel == SpMVKernel::Blocked){
+        //only the first column of a run is read, the run uses vec[column:column+length] directly
+        pattern.for_each_outer([&](std::size_t,std::size_t begin,std::size_t end){
+            for(std::size_t i=begin;i<end;++i){
                 T rowSum = static_cast<T>(0);
-                //Use Key to exctract the ith row
-                std::array<std::size_t,2> Key = {i,0};
-                auto it = matrix.elements.lower_bound(Key);
-                Key = {i+1,0};
-                auto it_end = matrix.elements.lower_bound(Key);
-                //Compute Rowsum
-                for(;it != it_end;++it){
-                    std::size_t j = it->first[1];
-                    if(mutableVec.elements.find({j,0}) != mutableVec.elements.end()){
-                        rowSum += it->second * mutableVec.elements.at({j,0});
+                for(std::size_t r=pattern.runPtr[i];r<pattern.runPtr[i+1];++r){
+                    const std::size_t first = pattern.runStart[r], length = pattern.runStart[r+1]-first;
+                    const T* x = vec.data() + pattern.innerIndex[first];
+                    for(std::size_t l=0;l<length;++l){
+                        rowSum += static_cast<T>(vals[first+l]) * x[l];
                     }
                 }
-                //assignment to the return value
                 result[i] = rowSum;
             }
-            return result;
-        }
-    }else if constexpr(Order == algebra::StorageOrder::ColumnMajor){
-             std::vector<T> result(matrix.numRows, static_cast<T>(0));
-    //Check for the correctness of dimension
-    if(vec.numRows != matrix.numRows and vec.numCols >1 ){
-        std::cerr<<"Error dimension not coeirent"<<std::endl;
-        return result;
+        });
+    }else{
+        pattern.for_each_outer([&](std::size_t,std::size_t begin,std::size_t end){
+            for(std::size_t i=begin;i<end;++i){
+                result[i] = row_sum(i);
+            }
+        });
     }
-    //the vector for semplicity must be stored in RowMajor since it is 
-    //a column vector
-    auto& mutableVec = const_cast<Matrix<T, StorageOrder::ColumnMajor>&>(vec);
-    if(mutableVec.isCompressed){
-        mutableVec.uncompress();
+}
+
+//Product result = matrix*vec, in parallel on parallel::num_threads() threads when the matrix is compressed.
+//The kernels that scatter in result (ColumnMajor or symmetric storage) use scatter_chunks.
+//result is written first by the threads that use it: with the split of the rows of the CSR kernels,
+//otherwise with the split of parallel::fill
+template<ScalarOrComplex T, StorageOrder Order, parallel::VectorOf<T> X, parallel::VectorOf<T> Y>
+void multiply(const Matrix<T,Order>& matrix,const X& vec,Y& result){
+    if(vec.size() != matrix.cols()){
+        throw std::invalid_argument("Error dimension not coeirent");
     }
-    if(!matrix.isCompressed){   
-       for(std::size_t j=0;j<matrix.numCols;++j){
-            auto it = matrix.elements.lower_bound({0,j});
-            auto it_end = matrix.elements.lower_bound({0,j+1});
-            for(;it!=it_end;++it){
-                std::size_t jj = it->first[0];
-                if(mutableVec.elements.find({jj,0}) != mutableVec.elements.end()){
-                    result[jj] += it->second * mutableVec.elements.at({jj,0});
-                }
+    const Symmetry symmetry = matrix.symmetry();
+    if(!matrix.is_compressed()){
+        result.assign(matrix.rows(),static_cast<T>(0));
+        matrix.for_each_stored([&](std::size_t row,std::size_t col,const T& value){
+            result[row] += value*vec[col];
+            //contribution of the symmetric element, that is not stored
+            if(symmetry != Symmetry::General && row != col){
+                result[col] += (symmetry == Symmetry::Hermitian ? conjugate(value) : value)*vec[row];
+            }
+        });
+        return;
+    }
+    const auto& pattern = *matrix.pattern();
+    if(Order == StorageOrder::RowMajor && symmetry == Symmetry::General){
+        parallel::resize(result,matrix.rows());
+    }else{
+        parallel::fill(result,matrix.rows(),static_cast<T>(0));
+    }
+    //the kernel is instantiated for the precision used to store the values,
+    //the accumulation is always done with the type T
+    matrix.visit_values([&](const auto& vals){
+        using Values = std::decay_t<decltype(vals)>;
+        if constexpr(std::is_same_v<Values,SplitComplexValues<RealType_t<T>>>){
+            if(Order == StorageOrder::RowMajor && symmetry == Symmetry::General){
+                //split storage: the parts of the values are separate arrays and the sums are real,
+                //so the inner loop has no complex multiplication. vec is read in place (its two
+                //parts are adjacent), without copies of it at every product
+                using Real = RealType_t<T>;
+                pattern.for_each_outer([&](std::size_t,std::size_t begin,std::size_t end){
+                    for(std::size_t i=begin;i<end;++i){
+                        Real sumReal = 0, sumImag = 0;
+                        for(std::size_t k=pattern.outerIndex[i];k<pattern.outerIndex[i+1];++k){
+                            const T& x = vec[pattern.innerIndex[k]];
+                            sumReal += vals.real[k]*x.real() - vals.imag[k]*x.imag();
+                            sumImag += vals.real[k]*x.imag() + vals.imag[k]*x.real();
+                        }
+                        result[i] = T(sumReal,sumImag);
+                    }
+                });
+                return;
             }
         }
-        return result;
+        if(Order == StorageOrder::RowMajor && symmetry == Symmetry::General){
+            multiply_rows(pattern,vals,vec,result,matrix.kernel());
+            return;
+        }
+        scatter_chunks(pattern,symmetry != Symmetry::General,result,[&](auto& local,std::size_t begin,std::size_t end){
+            for(std::size_t outer=begin;outer<end;++outer){
+                for(std::size_t k=pattern.outerIndex[outer];k<pattern.outerIndex[outer+1];++k){
+                    const std::size_t row = Order == StorageOrder::RowMajor ? outer : pattern.innerIndex[k];
+                    const std::size_t col = Order == StorageOrder::RowMajor ? pattern.innerIndex[k] : outer;
+                    const T value = static_cast<T>(vals[k]);
+                    local[row] += value*vec[col];
+                    //contribution of the symmetric element, that is not stored
+                    if(symmetry != Symmetry::General && row != col){
+                        local[col] += (symmetry == Symmetry::Hermitian ? conjugate(value) : value)*vec[row];
+                    }
+                }
+            }
+        });
+    });
+}
+
+//Product result = A^H vec with the conjugate transpose of matrix (the transpose for a real matrix),
+//without building it. The kernels of multiply exchange their roles: for a CSC matrix every thread
+//computes its own elements of the result, a CSR matrix scatters its rows with scatter_chunks
+template<ScalarOrComplex T, StorageOrder Order, parallel::VectorOf<T> X = std::vector<T>, parallel::VectorOf<T> Y>
+void multiply_adjoint(const Matrix<T,Order>& matrix,const X& vec,Y& result){
+    if(vec.size() != matrix.rows()){
+        throw std::invalid_argument("Error dimension not coeirent");
+    }
+    const Symmetry symmetry = matrix.symmetry();
+    if(symmetry == Symmetry::Hermitian){
+        //A^H = A
+        multiply(matrix,vec,result);
+        return;
+    }
+    if(!matrix.is_compressed()){
+        result.assign(matrix.cols(),static_cast<T>(0));
+        matrix.for_each_stored([&](std::size_t row,std::size_t col,const T& value){
+            result[col] += conjugate(value)*vec[row];
+            if(symmetry == Symmetry::Symmetric && row != col){
+                result[row] += conjugate(value)*vec[col];
+            }
+        });
+        return;
+    }
+    const auto& pattern = *matrix.pattern();
+    if(Order == StorageOrder::ColumnMajor && symmetry == Symmetry::General){
+        parallel::resize(result,matrix.cols());
     }else{
-        for(std::size_t j=0;j<matrix.numCols;++j){
-            for(std::size_t i=0;i<matrix.compressedMatrix[j].size();++i){
-                std::size_t ii=matrix.compressedMatrix[j][i].first;
-                if(mutableVec.elements.find({ii,0}) != mutableVec.elements.end()){
-                    result[ii] += matrix.compressedMatrix[j][i].second * mutableVec.elements.at({ii,0});
+        parallel::fill(result,matrix.cols(),static_cast<T>(0));
+    }
+    matrix.visit_values([&](const auto& vals){
+        if(Order == StorageOrder::ColumnMajor && symmetry == Symmetry::General){
+            //the column j of A is the row j of A^H
+            pattern.for_each_outer([&](std::size_t,std::size_t begin,std::size_t end){
+                for(std::size_t j=begin;j<end;++j){
+                    T sum = static_cast<T>(0);
+                    for(std::size_t k=pattern.outerIndex[j];k<pattern.outerIndex[j+1];++k){
+                        sum += conjugate(static_cast<T>(vals[k])) * vec[pattern.innerIndex[k]];
+                    }
+                    result[j] = sum;
+                }
+            });
+            return;
+        }
+        scatter_chunks(pattern,symmetry != Symmetry::General,result,[&](auto& local,std::size_t begin,std::size_t end){
+            for(std::size_t outer=begin;outer<end;++outer){
+                for(std::size_t k=pattern.outerIndex[outer];k<pattern.outerIndex[outer+1];++k){
+                    const std::size_t row = Order == StorageOrder::RowMajor ? outer : pattern.innerIndex[k];
+                    const std::size_t col = Order == StorageOrder::RowMajor ? pattern.innerIndex[k] : outer;
+                    const T value = conjugate(static_cast<T>(vals[k]));
+                    local[col] += value*vec[row];
+                    //contribution of the symmetric element, that is not stored
+                    if(symmetry == Symmetry::Symmetric && row != col){
+                        local[row] += value*vec[col];
+                    }
                 }
             }
-            return result;
+        });
+    });
+}
+
+//Times the kernels of the product on matrix (tuning::trials() products each, after one that warms up
+//the caches) and sets the fastest one, that is also cached for its pattern. Only the CSR product of
+//general matrices stored in full or reduced precision has more kernels, the others are left as they are
+template<ScalarOrComplex T, StorageOrder Order>
+SpMVKernel autotune(Matrix<T,Order>& matrix){
+    if(Order != StorageOrder::RowMajor || !matrix.is_compressed() || matrix.symmetry() != Symmetry::General || matrix.storage_precision() == StoragePrecision::Split){
+        return matrix.kernel();
+    }
+    const auto& structure = matrix.pattern()->structure;
+    std::vector<SpMVKernel> candidates = {SpMVKernel::RowByRow,SpMVKernel::Sliced};
+    if(!matrix.pattern()->runStart.empty()){
+        candidates.push_back(SpMVKernel::Blocked);
+    }
+    const std::vector<T> x(matrix.cols(),static_cast<T>(1));
+    parallel::first_touch_vector<T> y;
+    SpMVKernel best = matrix.kernel();
+    double bestTime = std::numeric_limits<double>::max();
+    for(auto kernel : candidates){
+        matrix.set_kernel(kernel);
+        multiply(matrix,x,y);
+        for(std::size_t t=0;t<tuning::trials();++t){
+            const auto start = std::chrono::steady_clock::now();
+            multiply(matrix,x,y);
+            const double time = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+            if(time < bestTime){
+                bestTime = time;
+                best = kernel;
+            }
         }
     }
+    matrix.set_kernel(best);
+    //a pattern that was not analyzed has no fingerprint
+    if(structure.fingerprint != 0){
+        tuning::store(structure.fingerprint,matrix.storage_precision(),best);
+    }
+    return best;
+}
+
+//Asynchronous result = matrix*vec on the thread pool: the product is done when the future is ready
+//(get() rethrows its exceptions). matrix, vec and result must not be changed or destroyed before
+template<ScalarOrComplex T, StorageOrder Order, parallel::VectorOf<T> X = std::vector<T>, parallel::VectorOf<T> Y>
+std::future<void> multiply_async(const Matrix<T,Order>& matrix,const X& vec,Y& result){
+    return parallel::async([&matrix,&vec,&result](){multiply(matrix,vec,result);});
+}
+
+//Scalar product conj(a)^T b, in parallel
+template<typename A,typename B>
+typename A::value_type dot(const A& a,const B& b){
+    using T = typename A::value_type;
+    if(a.size() != b.size()){
+        throw std::invalid_argument("Error dimension not coeirent");
     }
+    return parallel::reduce(a.size(),static_cast<T>(0),[&](std::size_t begin,std::size_t end){
+        T sum = static_cast<T>(0);
+        for(std::size_t i=begin;i<end;++i){
+            sum += conjugate(a[i])*b[i];
+        }
+        return sum;
+    });
 }
 
-}//name space algebra
\ No newline at end of file
+//Fused kernel: result = matrix*vec and the scalar product conj(w)^T result in a single pass,
+//so result is not read again from memory. Used by the iterative solvers
+template<ScalarOrComplex T, StorageOrder Order, parallel::VectorOf<T> X = std::vector<T>, parallel::VectorOf<T> Y, parallel::VectorOf<T> W = std::vector<T>>
+T multiply_dot(const Matrix<T,Order>& matrix,const X& vec,Y& result,const W& w){
+    if(Order != StorageOrder::RowMajor || !matrix.is_compressed() || matrix.symmetry() != Symmetry::General){
+        //the other kernels scatter in result, so the product has to be completed first
+        multiply(matrix,vec,result);
+        return dot(w,result);
+    }
+    if(vec.size() != matrix.cols() || w.size() != matrix.rows()){
+        throw std::invalid_argument("Error dimension not coeirent");
+    }
+    const auto& pattern = *matrix.pattern();
+    parallel::resize(result,matrix.rows());
+    return matrix.visit_values([&](const auto& vals){
+        return parallel::reduce_outer(pattern.outerIndex,pattern.byElements,static_cast<T>(0),[&](std::size_t begin,std::size_t end){
+            T sum = static_cast<T>(0);
+            for(std::size_t i=begin;i<end;++i){
+                T rowSum = static_cast<T>(0);
+                for(std::size_t k=pattern.outerIndex[i];k<pattern.outerIndex[i+1];++k){
+                    rowSum += static_cast<T>(vals[k]) * vec[pattern.innerIndex[k]];
+                }
+                result[i] = rowSum;
+                sum += conjugate(w[i])*rowSum;
+            }
+            return sum;
+        });
+    });
+}
+
+//When you do the multiplication between Matrix and vector the following implementation 
+//requires the fact that both matrix and vector are stored in the same order
+template<ScalarOrComplex T, StorageOrder Order>
+std::vector<T> operator*(const Matrix<T,Order>& matrix,const Matrix<T,Order>& vec){
+    if(vec.numRows != matrix.numCols || vec.numCols > 1){
+        std::cerr<<"Error dimension not coeirent"<<std::endl;
+        return std::vector<T>(matrix.numRows,static_cast<T>(0));
+    }
+    //the column vector is copied in a dense vector, so the product uses the same kernels
+    //(symmetric and parallel) of the product with std::vector
+    std::vector<T> dense(vec.numRows,static_cast<T>(0));
+    vec.for_each_stored([&dense](std::size_t i,std::size_t,const T& value){
+        dense[i] = value;
+    });
+    return matrix*dense;
+}
+//Returns alpha*A + beta*B for compressed matrices with the same sizes and symmetry.
+//If A and B have the same pattern the result shares it and only the values are combined,
+//otherwise the stored elements of every outer index are merged (they are sorted) in parallel:
+//a first pass counts the elements of the union and a second one writes their indexes and values
+//directly in the storage of the result. The result is stored with the precision of A
+template<ScalarOrComplex T, StorageOrder Order>
+Matrix<T,Order> add(const std::type_identity_t<T>& alpha,const Matrix<T,Order>& A,const std::type_identity_t<T>& beta,const Matrix<T,Order>& B){
+    if(!A.isCompressed || !B.isCompressed){
+        throw std::logic_error("The matrices must be compressed");
+    }
+    if(A.numRows != B.numRows || A.numCols != B.numCols){
+        throw std::invalid_argument("Error dimension not coeirent");
+    }
+    if(A.symmetryType != B.symmetryType || (A.symmetryType != Symmetry::General && A.storedTriangle != B.storedTriangle)){
+        throw std::invalid_argument("The matrices must have the same symmetry");
+    }
+    if(A.symmetryType == Symmetry::Hermitian && (std::imag(alpha) != 0 || std::imag(beta) != 0)){
+        throw std::invalid_argument("A Hermitian matrix can be scaled only by a real number");
+    }
+    const auto& patternA = *A.pattern_;
+    const auto& patternB = *B.pattern_;
+    const std::size_t numOuter = patternA.outerIndex.size()-1;
+    //the result is built without values, they are written once with the split of its pattern
+    using ValuesLater = typename Matrix<T,Order>::ValuesLater;
+    //equal index arrays, compared in parallel
+    auto equal = [](const auto& a,const auto& b){
+        return a.size() == b.size() && parallel::reduce(a.size(),true,[&](std::size_t begin,std::size_t end){
+            return std::equal(a.cbegin()+begin,a.cbegin()+end,b.cbegin()+begin);
+        },std::logical_and<>());
+    };
+    //different fingerprints are different patterns, without comparing the indexes
+    const bool samePattern = A.pattern_ == B.pattern_ ||
+        (patternA.structure.fingerprint == patternB.structure.fingerprint &&
+         equal(patternA.outerIndex,patternB.outerIndex) && equal(patternA.innerIndex,patternB.innerIndex));
+    if(samePattern){
+        //same pattern: no index work, the values are in the same positions
+        Matrix<T,Order> sum(A.pattern_,A.precision,A.symmetryType,A.storedTriangle,ValuesLater{});
+        A.visit_values([&](const auto& valsA){
+            B.visit_values([&](const auto& valsB){
+                sum.assign_values([&](std::size_t k){return alpha*static_cast<T>(valsA[k]) + beta*static_cast<T>(valsB[k]);});
+            });
+        });
+        sum.select_kernel();
+        return sum;
+    }
+    auto result = std::make_shared<SparsityPattern<Order>>();
+    result->numRows = A.numRows;
+    result->numCols = A.numCols;
+    result->outerIndex.assign(numOuter+1,0);
+    //calls f(inner,position in A,position in B) for the union of the elements of outer,
+    //the position is nonZeros() for the matrix that does not store the element
+    auto merge = [&](std::size_t outer,auto&& f){
+        std::size_t a = patternA.outerIndex[outer], b = patternB.outerIndex[outer];
+        const std::size_t endA = patternA.outerIndex[outer+1], endB = patternB.outerIndex[outer+1];
+        while(a < endA || b < endB){
+            if(b == endB || (a < endA && patternA.innerIndex[a] < patternB.innerIndex[b])){
+                f(patternA.innerIndex[a],a,patternB.nonZeros());
+                ++a;
+            }else if(a == endA || patternB.innerIndex[b] < patternA.innerIndex[a]){
+                f(patternB.innerIndex[b],patternA.nonZeros(),b);
+                ++b;
+            }else{
+                f(patternA.innerIndex[a],a,b);
+                ++a;
+                ++b;
+            }
+        }
+    };
+    parallel::for_each_chunk(numOuter,[&](std::size_t,std::size_t begin,std::size_t end){
+        for(std::size_t outer=begin;outer<end;++outer){
+            merge(outer,[&](std::size_t,std::size_t,std::size_t){++result->outerIndex[outer+1];});
+        }
+    });
+    std::partial_sum(result->outerIndex.cbegin(),result->outerIndex.cend(),result->outerIndex.begin());
+    result->balance();
+    result->innerIndex.resize(result->outerIndex.back());
+    //the union of two triangles is in the same triangle, the symmetry is kept
+    Matrix<T,Order> sum(result,A.precision,A.symmetryType,A.storedTriangle,ValuesLater{});
+    //the inner indexes and the values of an outer are written in the same pass
+    A.visit_values([&](const auto& valsA){
+        B.visit_values([&](const auto& valsB){
+            sum.assign_outer([&](std::size_t begin,std::size_t end,auto&& store){
+                std::size_t position = result->outerIndex[begin];
+                for(std::size_t outer=begin;outer<end;++outer){
+                    merge(outer,[&](std::size_t inner,std::size_t a,std::size_t b){
+                        T value = static_cast<T>(0);
+                        if(a != patternA.nonZeros()){
+                            value += alpha*static_cast<T>(valsA[a]);
+                        }
+                        if(b != patternB.nonZeros()){
+                            value += beta*static_cast<T>(valsB[b]);
+                        }
+                        result->innerIndex[position] = inner;
+                        store(position++,value);
+                    });
+                }
+            });
+        });
+    });
+    result->analyze(A.symmetryType);
+    sum.select_kernel();
+    return sum;
+}
+
+template<ScalarOrComplex T, StorageOrder Order>
+Matrix<T,Order> operator+(const Matrix<T,Order>& A,const Matrix<T,Order>& B){
+    return add(static_cast<T>(1),A,static_cast<T>(1),B);
+}
+
+template<ScalarOrComplex T, StorageOrder Order>
+Matrix<T,Order> operator-(const Matrix<T,Order>& A,const Matrix<T,Order>& B){
+    return add(static_cast<T>(1),A,static_cast<T>(-1),B);
+}
+
+//Submatrix with the rows rowSet and the columns colSet (in the given order, without repetitions),
+//returned compressed with the precision of matrix. The outer indexes of the result are built in
+//parallel: a first pass counts the elements of each one and a second pass copies their indexes and
+//values directly in the storage of the result.
+//For symmetric matrices only the principal submatrices with sorted indexes are supported
+//(rowSet == colSet), so the result keeps the symmetry and the stored triangle
+template<ScalarOrComplex T, StorageOrder Order>
+Matrix<T,Order> extract(const Matrix<T,Order>& matrix,const std::vector<std::size_t>& rowSet,const std::vector<std::size_t>& colSet){
+    if(!matrix.isCompressed){
+        throw std::logic_error("The matrix must be compressed");
+    }
+    for(auto index : rowSet){
+        if(index >= matrix.numRows){
+            throw std::out_of_range("Index out of boundary");
+        }
+    }
+    for(auto index : colSet){
+        if(index >= matrix.numCols){
+            throw std::out_of_range("Index out of boundary");
+        }
+    }
+    if(matrix.symmetryType != Symmetry::General &&
+       (rowSet != colSet || std::adjacent_find(rowSet.cbegin(),rowSet.cend(),std::greater_equal<>()) != rowSet.cend())){
+        throw std::invalid_argument("Only sorted principal submatrices of a symmetric matrix can be extracted");
+    }
+    constexpr bool byRow = Order == StorageOrder::RowMajor;
+    const auto& outerSet = byRow ? rowSet : colSet;
+    const auto& innerSet = byRow ? colSet : rowSet;
+    const auto& pattern = *matrix.pattern_;
+    //(old index,new index) of the selected inner indexes, sorted to merge them with the stored ones
+    std::vector<std::pair<std::size_t,std::size_t>> selected(innerSet.size());
+    for(std::size_t k=0;k<innerSet.size();++k){
+        selected[k] = {innerSet[k],k};
+    }
+    std::sort(selected.begin(),selected.end());
+    if(std::adjacent_find(selected.cbegin(),selected.cend(),[](const auto& a,const auto& b){return a.first == b.first;}) != selected.cend()){
+        throw std::invalid_argument("The indexes of the submatrix must be different");
+    }
+    //if the inner indexes are sorted the order of the stored elements is already the right one
+    const bool sorted = std::is_sorted(innerSet.cbegin(),innerSet.cend());
+    //calls f(position,new inner index) for the selected elements of the outer index
+    auto for_each_selected = [&](std::size_t outer,auto&& f){
+        auto it = selected.cbegin();
+        for(std::size_t k=pattern.outerIndex[outer];k<pattern.outerIndex[outer+1] && it != selected.cend();++k){
+            //the stored inner indexes are sorted, so the search starts from the last one found
+            it = std::lower_bound(it,selected.cend(),pattern.innerIndex[k],[](const auto& a,std::size_t b){return a.first < b;});
+            if(it != selected.cend() && it->first == pattern.innerIndex[k]){
+                f(k,it->second);
+            }
+        }
+    };
+    auto result = std::make_shared<SparsityPattern<Order>>();
+    result->numRows = rowSet.size();
+    result->numCols = colSet.size();
+    result->outerIndex.assign(outerSet.size()+1,0);
+    parallel::for_each_chunk(outerSet.size(),[&](std::size_t,std::size_t begin,std::size_t end){
+        for(std::size_t o=begin;o<end;++o){
+            for_each_selected(outerSet[o],[&](std::size_t,std::size_t){++result->outerIndex[o+1];});
+        }
+    });
+    std::partial_sum(result->outerIndex.cbegin(),result->outerIndex.cend(),result->outerIndex.begin());
+    result->balance();
+    result->innerIndex.resize(result->outerIndex.back());
+    //the submatrix is built without values, they are written with the indexes in one pass
+    //with the split of its pattern
+    Matrix<T,Order> submatrix(result,matrix.precision,matrix.symmetryType,matrix.storedTriangle,typename Matrix<T,Order>::ValuesLater{});
+    matrix.visit_values([&](const auto& vals){
+        submatrix.assign_outer([&](std::size_t begin,std::size_t end,auto&& store){
+            std::size_t position = result->outerIndex[begin];
+            if(sorted){
+                for(std::size_t o=begin;o<end;++o){
+                    for_each_selected(outerSet[o],[&](std::size_t k,std::size_t inner){
+                        result->innerIndex[position] = inner;
+                        store(position++,static_cast<T>(vals[k]));
+                    });
+                }
+                return;
+            }
+            //the elements of an outer are sorted by the new inner index
+            std::vector<std::pair<std::size_t,T>> entries;
+            for(std::size_t o=begin;o<end;++o){
+                entries.clear();
+                for_each_selected(outerSet[o],[&](std::size_t k,std::size_t inner){
+                    entries.emplace_back(inner,static_cast<T>(vals[k]));
+                });
+                std::sort(entries.begin(),entries.end(),[](const auto& a,const auto& b){return a.first < b.first;});
+                for(const auto& [inner,value] : entries){
+                    result->innerIndex[position] = inner;
+                    store(position++,value);
+                }
+            }
+        });
+    });
+    result->analyze(matrix.symmetryType);
+    submatrix.select_kernel();
+    return submatrix;
+}
+}//name space algebra
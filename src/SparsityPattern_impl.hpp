@@ -0,0 +1,243 @@
+#include "SparseMatrix.hpp"
+
+namespace algebra {
+
+    template<StorageOrder Order>
+    std::size_t SparsityPattern<Order>::locate(std::size_t row,std::size_t col)const{
+        //RowMajor: outer = row, inner = col. ColumnMajor: outer = col, inner = row
+        std::size_t outer = (Order == StorageOrder::RowMajor) ? row : col;
+        std::size_t inner = (Order == StorageOrder::RowMajor) ? col : row;
+        //the inner indexes of each outer are sorted, so a binary search is enough
+        auto first = innerIndex.cbegin() + outerIndex[outer];
+        auto last = innerIndex.cbegin() + outerIndex[outer+1];
+        auto it = std::lower_bound(first,last,inner);
+        if(it != last && *it == inner){
+            return static_cast<std::size_t>(it - innerIndex.cbegin());
+        }
+        return innerIndex.size();
+    }
+
+    template<StorageOrder Order>
+    bool SparsityPattern<Order>::in_triangle(Triangle triangle)const{
+        if(numRows != numCols){
+            return false;
+        }
+        //the inner indexes of each outer are sorted, so only the first or the last one is checked:
+        //the first one for the inner indexes that must be >= outer
+        const bool checkFirst = (triangle == Triangle::Lower) == (Order == StorageOrder::ColumnMajor);
+        return parallel::reduce(outerIndex.size()-1,true,[&](std::size_t begin,std::size_t end){
+            for(std::size_t outer=begin;outer<end;++outer){
+                if(outerIndex[outer] == outerIndex[outer+1]){
+                    continue;
+                }
+                if(checkFirst ? innerIndex[outerIndex[outer]] < outer : innerIndex[outerIndex[outer+1]-1] > outer){
+                    return false;
+                }
+            }
+            return true;
+        },std::logical_and<>());
+    }
+
+    template<StorageOrder Order>
+    void SparsityPattern<Order>::balance(){
+        //split by elements when the standard deviation of the lengths is larger than their mean
+        const std::size_t numOuter = outerIndex.size()-1;
+        const double sumSquares = parallel::reduce(numOuter,0.0,[this](std::size_t begin,std::size_t end){
+            double sum = 0.0;
+            for(std::size_t outer=begin;outer<end;++outer){
+                const auto length = static_cast<double>(outerIndex[outer+1]-outerIndex[outer]);
+                sum += length*length;
+            }
+            return sum;
+        });
+        const double n = std::max<double>(1,static_cast<double>(numOuter));
+        const double mean = static_cast<double>(outerIndex.back())/n;
+        byElements = sumSquares/n - mean*mean > mean*mean;
+    }
+
+    template<StorageOrder Order>
+    void SparsityPattern<Order>::analyze(Symmetry symmetry){
+        const std::size_t numOuter = outerIndex.size()-1;
+        //statistics of a block of outer indexes, the blocks are combined by reduce
+        struct Partial {
+            std::size_t minLength = std::numeric_limits<std::size_t>::max();
+            std::size_t maxLength = 0;
+            double sumSquares = 0;
+            std::size_t bandwidth = 0;
+            std::size_t runs = 0;
+            std::uint64_t hash = 0;
+        };
+        //the hash of an outer does not depend on the split among the threads (splitmix64 of FNV-1a)
+        auto mix = [](std::uint64_t h,std::uint64_t value){return (h ^ value)*0x100000001b3ull;};
+        auto finalize = [](std::uint64_t h){
+            h = (h ^ (h >> 30))*0xbf58476d1ce4e5b9ull;
+            h = (h ^ (h >> 27))*0x94d049bb133111ebull;
+            return h ^ (h >> 31);
+        };
+        const Partial total = parallel::reduce(numOuter,Partial{},[&](std::size_t begin,std::size_t end){
+            Partial p;
+            for(std::size_t outer=begin;outer<end;++outer){
+                const std::size_t length = outerIndex[outer+1]-outerIndex[outer];
+                p.minLength = std::min(p.minLength,length);
+                p.maxLength = std::max(p.maxLength,length);
+                p.sumSquares += static_cast<double>(length)*static_cast<double>(length);
+                std::uint64_t h = mix(0xcbf29ce484222325ull,outer);
+                for(std::size_t k=outerIndex[outer];k<outerIndex[outer+1];++k){
+                    const std::size_t inner = innerIndex[k];
+                    p.bandwidth = std::max(p.bandwidth,inner > outer ? inner-outer : outer-inner);
+                    if(k == outerIndex[outer] || inner != innerIndex[k-1]+1){
+                        ++p.runs;
+                    }
+                    h = mix(h,inner);
+                }
+                p.hash += finalize(h);
+            }
+            return p;
+        },[](Partial a,const Partial& b){
+            a.minLength = std::min(a.minLength,b.minLength);
+            a.maxLength = std::max(a.maxLength,b.maxLength);
+            a.sumSquares += b.sumSquares;
+            a.bandwidth = std::max(a.bandwidth,b.bandwidth);
+            a.runs += b.runs;
+            a.hash += b.hash;
+            return a;
+        });
+        const double n = std::max<double>(1,static_cast<double>(numOuter));
+        structure.minLength = numOuter == 0 ? 0 : total.minLength;
+        structure.maxLength = total.maxLength;
+        structure.meanLength = static_cast<double>(nonZeros())/n;
+        structure.lengthDeviation = std::sqrt(std::max(0.0,total.sumSquares/n - structure.meanLength*structure.meanLength));
+        structure.bandwidth = total.bandwidth;
+        structure.meanRun = total.runs == 0 ? 0 : static_cast<double>(nonZeros())/static_cast<double>(total.runs);
+        structure.fingerprint = mix(mix(mix(total.hash,numRows),numCols),static_cast<std::uint64_t>(Order));
+        //only the product of a CSR general matrix has the Blocked kernel
+        structure.kernel = choose_kernel(structure,Order == StorageOrder::RowMajor && symmetry == Symmetry::General);
+        runPtr.clear();
+        runStart.clear();
+        if(structure.kernel != SpMVKernel::Blocked){
+            return;
+        }
+        //runs counted by outer and then written, with the split of the kernels
+        runPtr.resize(numOuter+1);
+        runPtr[0] = 0;
+        auto for_each_run = [this](std::size_t outer,auto&& f){
+            for(std::size_t k=outerIndex[outer];k<outerIndex[outer+1];++k){
+                if(k == outerIndex[outer] || innerIndex[k] != innerIndex[k-1]+1){
+                    f(k);
+                }
+            }
+        };
+        for_each_outer([&](std::size_t,std::size_t begin,std::size_t end){
+            for(std::size_t outer=begin;outer<end;++outer){
+                runPtr[outer+1] = 0;
+                for_each_run(outer,[&](std::size_t){++runPtr[outer+1];});
+            }
+        });
+        std::partial_sum(runPtr.cbegin(),runPtr.cend(),runPtr.begin());
+        runStart.resize(runPtr.back()+1);
+        runStart.back() = nonZeros();
+        for_each_outer([&](std::size_t,std::size_t begin,std::size_t end){
+            for(std::size_t outer=begin;outer<end;++outer){
+                std::size_t r = runPtr[outer];
+                for_each_run(outer,[&](std::size_t k){runStart[r++] = k;});
+            }
+        });
+    }
+
+    //Positions of the stored elements grouped by row (or by column): the row i has the elements
+    //pos[ptr[i]:ptr[i+1]], in the columns index[ptr[i]:ptr[i+1]] (sorted). With the ColumnMajor
+    //storage the lists by row are the transposed index, the values are not moved
+    struct EntryLists {
+        std::vector<std::size_t> ptr;
+        std::vector<std::size_t> pos;
+        std::vector<std::size_t> index;
+    };
+
+    template<StorageOrder Order>
+    EntryLists entry_lists(const SparsityPattern<Order>& pattern,bool byRow){
+        const bool byOuter = byRow == (Order == StorageOrder::RowMajor);
+        const std::size_t numOuter = pattern.outerIndex.size()-1;
+        EntryLists lists;
+        if(byOuter){
+            lists.ptr.assign(pattern.outerIndex.cbegin(),pattern.outerIndex.cend());
+            lists.pos.resize(pattern.nonZeros());
+            std::iota(lists.pos.begin(),lists.pos.end(),0);
+            lists.index.assign(pattern.innerIndex.cbegin(),pattern.innerIndex.cend());
+            return lists;
+        }
+        //counting sort on the inner index, the outer indexes arrive already sorted
+        const std::size_t numInner = Order == StorageOrder::RowMajor ? pattern.numCols : pattern.numRows;
+        lists.ptr.assign(numInner+1,0);
+        for(auto inner : pattern.innerIndex){
+            ++lists.ptr[inner+1];
+        }
+        std::partial_sum(lists.ptr.cbegin(),lists.ptr.cend(),lists.ptr.begin());
+        lists.pos.resize(pattern.nonZeros());
+        lists.index.resize(pattern.nonZeros());
+        std::vector<std::size_t> next(lists.ptr.cbegin(),lists.ptr.cend()-1);
+        for(std::size_t outer=0;outer<numOuter;++outer){
+            for(std::size_t k=pattern.outerIndex[outer];k<pattern.outerIndex[outer+1];++k){
+                auto e = next[pattern.innerIndex[k]]++;
+                lists.pos[e] = k;
+                lists.index[e] = outer;
+            }
+        }
+        return lists;
+    }
+
+    //Calls f(ptr,index,position) with the lists by row (or by column) of the stored elements, the
+    //element e of the lists is in position(e) of the values. When the lists are the ones of the
+    //storage the arrays of the pattern are used directly, otherwise they are built by entry_lists
+    template<StorageOrder Order,typename F>
+    void visit_entry_lists(const SparsityPattern<Order>& pattern,bool byRow,F&& f){
+        if(byRow == (Order == StorageOrder::RowMajor)){
+            f(pattern.outerIndex,pattern.innerIndex,[](std::size_t e){return e;});
+            return;
+        }
+        const EntryLists lists = entry_lists(pattern,byRow);
+        f(lists.ptr,lists.index,[&lists](std::size_t e){return lists.pos[e];});
+    }
+
+    template<StorageOrder Order>
+    PatternMatrix<Order>::PatternMatrix(PatternPtr<Order> pattern): pattern_(std::move(pattern)){
+        if(!pattern_){
+            throw std::invalid_argument("The pattern is empty");
+        }
+    }
+
+    template<StorageOrder Order>
+    bool PatternMatrix<Order>::operator()(std::size_t row,std::size_t col)const{
+        if(row < pattern_->numRows && col < pattern_->numCols){
+            return pattern_->locate(row,col) != pattern_->nonZeros();
+        }
+        throw std::out_of_range("Index out of boundary");
+    }
+
+    template<StorageOrder Order>
+    std::vector<bool> operator*(const PatternMatrix<Order>& matrix,const std::vector<bool>& vec){
+        const auto& pattern = *matrix.pattern();
+        std::vector<bool> result(pattern.numRows,false);
+        if(vec.size() != pattern.numCols){
+            std::cerr<<"Error dimension not coeirent"<<std::endl;
+            return result;
+        }
+        if constexpr(Order == StorageOrder::RowMajor){
+            for(std::size_t i=0;i<pattern.numRows;++i){
+                //stop at the first column that reaches a true entry
+                for(std::size_t k=pattern.outerIndex[i];k<pattern.outerIndex[i+1] && !result[i];++k){
+                    result[i] = vec[pattern.innerIndex[k]];
+                }
+            }
+        }else{
+            for(std::size_t j=0;j<pattern.numCols;++j){
+                if(!vec[j]){
+                    continue;
+                }
+                for(std::size_t k=pattern.outerIndex[j];k<pattern.outerIndex[j+1];++k){
+                    result[pattern.innerIndex[k]] = true;
+                }
+            }
+        }
+        return result;
+    }
+}  // namespace algebra
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <filesystem>
 #include "SparseMatrix.hpp"  // Include the header file with SparseMatrix implementation
 #include "chrono.hpp" //Include of the Professor's Formaggia Utilities
 int main() {
@@ -124,6 +125,319 @@ int main() {
         std::cout<<res[i];
     }
     std::cout<<std::endl;
-    
-    return 0; 
+    std::cout<<std::endl;
+    //compressed matrix with the values stored in single precision
+    std::cout<<"REDUCED PRECISION STORAGE"<<std::endl;
+    algebra::Matrix<double,algebra::StorageOrder::RowMajor> C(0,0);
+    algebra::read(C,"lnsp_131.mtx");
+    C.compress(algebra::StoragePrecision::Reduced);
+    chrono.start();
+    x = C*a;
+    chrono.stop();
+    std::cout<<"The Matrix vector product requires: "<<chrono.wallTime()<<" micsec"<<std::endl;
+    for(std::size_t i=0;i<131;++i){
+        std::cout<<x[i];
+    }
+    std::cout<<std::endl;
+    //matrix that shares the pattern of C: only the values are allocated
+    algebra::Matrix<double,algebra::StorageOrder::RowMajor> D(C.pattern());
+    D(0,0) = 2.0;
+    std::cout<<"Non zero elements of the matrix with shared pattern: "<<D.nonZeros()<<std::endl;
+    //structural matrix on the same pattern: one step of the graph from the vertex 0, the vertices i
+    //with (i,0) stored, checked with the positions of the pattern
+    algebra::PatternMatrix<algebra::StorageOrder::RowMajor> P(C.pattern());
+    std::vector<bool> seed(P.cols(),false);
+    seed[0] = true;
+    const std::vector<bool> reached = P*seed;
+    std::size_t numReached = 0;
+    bool sameReach = true;
+    for(std::size_t i=0;i<P.rows();++i){
+        numReached += reached[i];
+        sameReach = sameReach && reached[i] == (C.pattern()->locate(i,0) != C.nonZeros());
+    }
+    std::cout<<"Vertices reached in one step from the vertex 0: "<<numReached<<", as in the pattern: "<<sameReach<<std::endl;
+    std::cout<<std::endl;
+    //complex Hermitian matrix stored with the real and imaginary parts split, solved with
+    //the conjugate gradient preconditioned by the incomplete Cholesky factorization
+    std::cout<<"COMPLEX PRECONDITIONED SOLVE"<<std::endl;
+    using Complex = std::complex<double>;
+    const std::size_t n = 1000;
+    algebra::Matrix<Complex,algebra::StorageOrder::RowMajor> H(n,n);
+    for(std::size_t i=0;i<n;++i){
+        H(i,i) = 5.0;
+        if(i > 0){
+            H(i,i-1) = Complex(-1.0,0.5);
+        }
+        if(i >= 30){
+            H(i,i-30) = Complex(-1.0,-0.2);
+        }
+    }
+    H.set_symmetry(algebra::Symmetry::Hermitian);
+    H.compress(algebra::StoragePrecision::Split);
+    std::vector<Complex> rhs(n,Complex(1.0,-1.0)),sol;
+    algebra::IC0<Complex,algebra::StorageOrder::RowMajor> ic(H);
+    algebra::ConjugateGradient<Complex,algebra::StorageOrder::RowMajor> cg;
+    chrono.start();
+    algebra::SolverResult result = cg.solve(H,rhs,sol,ic);
+    chrono.stop();
+    std::cout<<"The solve requires: "<<chrono.wallTime()<<" micsec"<<std::endl;
+    std::cout<<"Converged: "<<result.converged<<" iterations: "<<result.iterations<<" residual: "<<result.residual<<std::endl;
+    std::cout<<std::endl;
+    //the products of the symmetric storages and of the ColumnMajor matrix are compared with
+    //the one of the general RowMajor matrix, on a symmetric banded matrix
+    std::cout<<"PRODUCTS COMPARED WITH THE GENERAL ROW MAJOR MATRIX"<<std::endl;
+    const std::size_t m = 20000;
+    const std::size_t band = 4;
+    algebra::Matrix<double,algebra::StorageOrder::RowMajor> G(m,m);
+    algebra::Matrix<double,algebra::StorageOrder::RowMajor> L(m,m);
+    algebra::Matrix<double,algebra::StorageOrder::RowMajor> U(m,m);
+    algebra::Matrix<double,algebra::StorageOrder::ColumnMajor> E(m,m);
+    for(std::size_t i=0;i<m;++i){
+        for(std::size_t j=(i>band ? i-band : 0);j<=std::min(m-1,i+band);++j){
+            const double value = i == j ? 4.0 : 1.0/(1.0 + std::abs(double(i)-double(j)));
+            G(i,j) = value;
+            L(i,j) = value;
+            U(i,j) = value;
+            E(i,j) = value;
+        }
+    }
+    //the symmetric matrices keep one triangle
+    L.set_symmetry(algebra::Symmetry::Symmetric,algebra::Triangle::Lower);
+    U.set_symmetry(algebra::Symmetry::Symmetric,algebra::Triangle::Upper);
+    G.compress();
+    L.compress();
+    U.compress();
+    E.compress();
+    std::vector<double> v(m),reference,y;
+    for(std::size_t i=0;i<m;++i){
+        v[i] = std::sin(double(i));
+    }
+    //largest difference with the product of the general matrix
+    auto difference = [&reference](const std::vector<double>& w){
+        double diff = 0.0;
+        for(std::size_t i=0;i<w.size();++i){
+            diff = std::max(diff,std::abs(w[i]-reference[i]));
+        }
+        return diff;
+    };
+    G.set_kernel(algebra::SpMVKernel::RowByRow);
+    chrono.start();
+    algebra::multiply(G,v,reference);
+    chrono.stop();
+    std::cout<<"General RowMajor (row by row) requires: "<<chrono.wallTime()<<" micsec"<<std::endl;
+    //the kernels chosen from the structure of the pattern, the rows are runs of 9 consecutive columns
+    G.set_kernel(algebra::SpMVKernel::Sliced);
+    chrono.start();
+    algebra::multiply(G,v,y);
+    chrono.stop();
+    std::cout<<"Sliced kernel requires: "<<chrono.wallTime()<<" micsec, difference: "<<difference(y)<<std::endl;
+    G.set_kernel(algebra::SpMVKernel::Blocked);
+    chrono.start();
+    algebra::multiply(G,v,y);
+    chrono.stop();
+    std::cout<<"Blocked kernel requires: "<<chrono.wallTime()<<" micsec, difference: "<<difference(y)<<std::endl;
+    chrono.start();
+    algebra::multiply(L,v,y);
+    chrono.stop();
+    std::cout<<"Symmetric (lower triangle) requires: "<<chrono.wallTime()<<" micsec, difference: "<<difference(y)<<std::endl;
+    chrono.start();
+    algebra::multiply(U,v,y);
+    chrono.stop();
+    std::cout<<"Symmetric (upper triangle) requires: "<<chrono.wallTime()<<" micsec, difference: "<<difference(y)<<std::endl;
+    chrono.start();
+    algebra::multiply(E,v,y);
+    chrono.stop();
+    std::cout<<"ColumnMajor requires: "<<chrono.wallTime()<<" micsec, difference: "<<difference(y)<<std::endl;
+    //the private buffers of the products that scatter (symmetric and ColumnMajor) are kept by the
+    //threads for the next products, until they are released
+    algebra::release_scatter_buffers<double>();
+    //the product runs on the pool while this thread is free
+    chrono.start();
+    std::future<void> product = algebra::multiply_async(G,v,y);
+    product.get();
+    chrono.stop();
+    std::cout<<"Asynchronous product requires: "<<chrono.wallTime()<<" micsec, difference: "<<difference(y)<<std::endl;
+    //the matrix read from a binary file in chunks of 10000 elements, the file is removed at the end
+    const std::string binaryName = (std::filesystem::temp_directory_path()/"band.bin").string();
+    algebra::write_binary(G,binaryName);
+    algebra::StreamingMatrix<double> binaryFile(binaryName,10000);
+    chrono.start();
+    binaryFile.multiply(v,y);
+    chrono.stop();
+    std::cout<<"Streaming from the binary file requires: "<<chrono.wallTime()<<" micsec, difference: "<<difference(y)<<std::endl;
+    std::filesystem::remove(binaryName);
+    //the matrix written in a Matrix Market file and read back in chunks by the streaming product
+    const std::string mtxName = (std::filesystem::temp_directory_path()/"band.mtx").string();
+    algebra::write_mtx(G,mtxName);
+    algebra::StreamingMatrix<double> mtxFile(mtxName,10000);
+    chrono.start();
+    mtxFile.multiply(v,y);
+    chrono.stop();
+    std::cout<<"Streaming from the Matrix Market file requires: "<<chrono.wallTime()<<" micsec, difference: "<<difference(y)<<std::endl;
+    std::filesystem::remove(mtxName);
+    std::cout<<std::endl;
+    //submatrices of the banded matrices, compared element by element with the original ones
+    std::cout<<"SUBMATRICES AND VIEWS"<<std::endl;
+    //value of the element, zero if it is not stored (the const operator() throws for a compressed matrix)
+    auto entry = [](const auto& M,std::size_t i,std::size_t j){
+        try{
+            return M(i,j);
+        }catch(const std::out_of_range&){
+            return 0.0;
+        }
+    };
+    //true if all the elements of the submatrix are the ones of the selected rows and columns
+    auto sameBlock = [&entry](const auto& M,const auto& sub,const std::vector<std::size_t>& rowSet,const std::vector<std::size_t>& colSet){
+        for(std::size_t i=0;i<rowSet.size();++i){
+            for(std::size_t j=0;j<colSet.size();++j){
+                if(entry(sub,i,j) != entry(M,rowSet[i],colSet[j])){
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+    const std::vector<std::size_t> blockRows{100,101,102,103,104,105,106,107};
+    //columns not sorted, the submatrix keeps the given order
+    const std::vector<std::size_t> blockCols{105,98,103,101,100,110};
+    //principal submatrix, the only one available for the symmetric storage
+    const std::vector<std::size_t> principal{200,201,202,203,204,210};
+    auto subG = algebra::extract(G,blockRows,blockCols);
+    auto subE = algebra::extract(E,blockRows,blockCols);
+    auto subL = algebra::extract(L,principal,principal);
+    auto subU = algebra::extract(U,principal,principal);
+    std::cout<<"RowMajor block: "<<subG.nonZeros()<<" elements, as in the matrix: "<<sameBlock(G,subG,blockRows,blockCols)<<std::endl;
+    std::cout<<"ColumnMajor block: "<<subE.nonZeros()<<" elements, as in the matrix: "<<sameBlock(E,subE,blockRows,blockCols)<<std::endl;
+    std::cout<<"Symmetric (lower triangle) block: "<<subL.nonZeros()<<" elements, as in the matrix: "<<sameBlock(L,subL,principal,principal)<<std::endl;
+    std::cout<<"Symmetric (upper triangle) block: "<<subU.nonZeros()<<" elements, as in the matrix: "<<sameBlock(U,subU,principal,principal)<<std::endl;
+    //the views read the stored elements of a row or of a column without copies
+    const algebra::SparseVectorView<double> rowView = G.row(100);
+    std::cout<<"Row 100 of the RowMajor matrix:";
+    for(std::size_t k=0;k<rowView.size();++k){
+        std::cout<<" ("<<rowView.index[k]<<","<<rowView.values[k]<<")";
+    }
+    std::cout<<std::endl;
+    const algebra::SparseVectorView<double> colView = E.col(100);
+    bool sameCol = colView.size() == rowView.size();
+    for(std::size_t k=0;k<colView.size();++k){
+        sameCol = sameCol && colView.values[k] == E(colView.index[k],100);
+    }
+    std::cout<<"Column 100 of the ColumnMajor matrix: "<<colView.size()<<" elements, as in the matrix: "<<sameCol<<std::endl;
+    std::cout<<std::endl;
+    //M + dt*K with the banded matrix as K and a tridiagonal mass matrix, the products of the sums
+    //are compared with the combinations of the products of the two matrices
+    std::cout<<"SUMS OF MATRICES"<<std::endl;
+    const double dt = 0.01;
+    algebra::Matrix<double,algebra::StorageOrder::RowMajor> mass(m,m);
+    algebra::Matrix<double,algebra::StorageOrder::ColumnMajor> massColumn(m,m);
+    //the same mass matrix on the pattern of the banded matrix, the other elements are zero
+    algebra::Matrix<double,algebra::StorageOrder::RowMajor> massShared(G.pattern());
+    for(std::size_t i=0;i<m;++i){
+        for(std::size_t j=(i>0 ? i-1 : 0);j<=std::min(m-1,i+1);++j){
+            const double value = i == j ? 2.0/3.0 : 1.0/6.0;
+            mass(i,j) = value;
+            massColumn(i,j) = value;
+            massShared(i,j) = value;
+        }
+    }
+    mass.compress();
+    massColumn.compress();
+    std::vector<double> productA,productB;
+    //reference = alpha*(A*v) + beta*(B*v), to compare it with (alpha*A + beta*B)*v
+    auto combination = [&](double alpha,const auto& A,double beta,const auto& B){
+        algebra::multiply(A,v,productA);
+        algebra::multiply(B,v,productB);
+        reference.resize(m);
+        for(std::size_t i=0;i<m;++i){
+            reference[i] = alpha*productA[i] + beta*productB[i];
+        }
+    };
+    //different patterns: the pattern of the sum is the union of the two
+    chrono.start();
+    auto system = algebra::add(1.0,mass,dt,G);
+    chrono.stop();
+    combination(1.0,mass,dt,G);
+    algebra::multiply(system,v,y);
+    std::cout<<"RowMajor sum with different patterns requires: "<<chrono.wallTime()<<" micsec, difference: "<<difference(y)<<std::endl;
+    auto systemColumn = algebra::add(1.0,massColumn,dt,E);
+    combination(1.0,massColumn,dt,E);
+    algebra::multiply(systemColumn,v,y);
+    std::cout<<"ColumnMajor sum with different patterns, difference: "<<difference(y)<<std::endl;
+    //shared pattern: only the values are computed, the result keeps the pattern
+    chrono.start();
+    auto systemShared = algebra::add(1.0,massShared,dt,G);
+    chrono.stop();
+    combination(1.0,massShared,dt,G);
+    algebra::multiply(systemShared,v,y);
+    std::cout<<"Sum with shared pattern requires: "<<chrono.wallTime()<<" micsec, difference: "<<difference(y)<<std::endl;
+    std::cout<<"The sum shares the pattern: "<<(systemShared.pattern() == G.pattern())<<std::endl;
+    //the operators are add with the coefficients 1 and -1, and the scaling of the values
+    auto sum = mass + G;
+    combination(1.0,mass,1.0,G);
+    algebra::multiply(sum,v,y);
+    std::cout<<"operator+ difference: "<<difference(y)<<std::endl;
+    auto diff = mass - G;
+    combination(1.0,mass,-1.0,G);
+    algebra::multiply(diff,v,y);
+    std::cout<<"operator- difference: "<<difference(y)<<std::endl;
+    sum *= dt;
+    combination(dt,mass,dt,G);
+    algebra::multiply(sum,v,y);
+    std::cout<<"operator*= difference: "<<difference(y)<<std::endl;
+    std::cout<<std::endl;
+    //the solvers on a symmetric matrix (CG) and on a not symmetric one (BiCGStab and GMRES), the
+    //band and a coupling at distance 100, so that the incomplete factorizations are not exact
+    std::cout<<"ITERATIVE SOLVERS"<<std::endl;
+    const std::size_t coupling = 100;
+    algebra::Matrix<double,algebra::StorageOrder::RowMajor> S(m,m);
+    algebra::Matrix<double,algebra::StorageOrder::RowMajor> N(m,m);
+    for(std::size_t i=0;i<m;++i){
+        for(std::size_t j=(i>band ? i-band : 0);j<=std::min(m-1,i+band);++j){
+            S(i,j) = i == j ? 4.0 : 1.0/(1.0 + std::abs(double(i)-double(j)));
+            //the elements above the diagonal are changed sign
+            N(i,j) = i == j ? 4.0 : (j > i ? -1.0 : 0.5)/(1.0 + std::abs(double(i)-double(j)));
+        }
+        if(i >= coupling){
+            S(i,i-coupling) = 0.5;
+            S(i-coupling,i) = 0.5;
+            N(i,i-coupling) = 0.5;
+            N(i-coupling,i) = -0.5;
+        }
+    }
+    S.set_symmetry(algebra::Symmetry::Symmetric);
+    S.compress();
+    N.compress();
+    std::vector<double> b(m,1.0),solution;
+    algebra::IC0<double,algebra::StorageOrder::RowMajor> ic0(S);
+    algebra::ConjugateGradient<double,algebra::StorageOrder::RowMajor> conjugate;
+    chrono.start();
+    result = conjugate.solve(S,b,solution,ic0);
+    chrono.stop();
+    std::cout<<"CG with IC0 requires: "<<chrono.wallTime()<<" micsec"<<std::endl;
+    std::cout<<"Converged: "<<result.converged<<" iterations: "<<result.iterations<<" residual: "<<result.residual<<std::endl;
+    //each solve starts from x = 0
+    solution.clear();
+    algebra::PipelinedCG<double,algebra::StorageOrder::RowMajor> pipelined;
+    chrono.start();
+    result = pipelined.solve(S,b,solution,ic0);
+    chrono.stop();
+    std::cout<<"Pipelined CG with IC0 requires: "<<chrono.wallTime()<<" micsec"<<std::endl;
+    std::cout<<"Converged: "<<result.converged<<" iterations: "<<result.iterations<<" residual: "<<result.residual<<std::endl;
+    solution.clear();
+    algebra::ILU0<double,algebra::StorageOrder::RowMajor> ilu0(N);
+    algebra::BiCGStab<double,algebra::StorageOrder::RowMajor> bicgstab;
+    chrono.start();
+    result = bicgstab.solve(N,b,solution,ilu0);
+    chrono.stop();
+    std::cout<<"BiCGStab with ILU0 requires: "<<chrono.wallTime()<<" micsec"<<std::endl;
+    std::cout<<"Converged: "<<result.converged<<" iterations: "<<result.iterations<<" residual: "<<result.residual<<std::endl;
+    solution.clear();
+    algebra::GMRES<double,algebra::StorageOrder::RowMajor> gmres;
+    chrono.start();
+    result = gmres.solve(N,b,solution,ilu0);
+    chrono.stop();
+    std::cout<<"GMRES with ILU0 requires: "<<chrono.wallTime()<<" micsec"<<std::endl;
+    std::cout<<"Converged: "<<result.converged<<" iterations: "<<result.iterations<<" residual: "<<result.residual<<std::endl;
+
+    return 0;
 }